@@ -0,0 +1,138 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             checksum_bench.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Microbenchmark of packet checksum implementations across
+*        payload sizes.
+*
+*******************************************************************/
+/**
+* @file checksum_bench.c
+*
+* @brief Microbenchmark of packet checksum implementations across
+* @brief payload sizes.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "../libs/rdt.h"
+
+// Number of bytes summed by each measurement
+#define BENCH_BYTES (256 * 1024 * 1024)
+
+/**
+ * Benchmarked implementation.
+ */
+typedef struct {
+    const char *name;                                            /**< name of implementation */
+    int supported;                                               /**< 1 whether CPU supports it */
+    int slow;                                                    /**< 1 whether runs less rounds */
+    uint32_t (*run)(const unsigned char *data, size_t size);     /**< implementation */
+    uint32_t (*reference)(const unsigned char *data, size_t size); /**< result has to match it */
+} TVariant;
+
+/**
+ * Wrappers of implementations with the same signature.
+ * @param data Summed data.
+ * @param size Size of data.
+ * @return Checksum or CRC.
+ */
+static uint32_t runScalar(const unsigned char *data, size_t size) {
+    return checksumScalar(data, size);
+}
+
+static uint32_t runCrcSw(const unsigned char *data, size_t size) {
+    return ~crc32cSw(~0U, data, size);
+}
+
+#ifdef RDT_X86
+static uint32_t runSse2(const unsigned char *data, size_t size) {
+    return checksumSse2(data, size);
+}
+
+static uint32_t runAvx2(const unsigned char *data, size_t size) {
+    return checksumAvx2(data, size);
+}
+
+static uint32_t runCrcHw(const unsigned char *data, size_t size) {
+    return ~crc32cHw(~0U, data, size);
+}
+#endif
+
+/**
+ * Returns current time in seconds.
+ * @return Current time.
+ */
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    const size_t sizes[] = { 64, 256, 1410, 9000, 65507 };
+    TVariant variants[] = {
+        { "scalar",     1, 0, runScalar, runScalar },
+#ifdef RDT_X86
+        { "sse2",       __builtin_cpu_supports("sse2"), 0, runSse2, runScalar },
+        { "avx2",       __builtin_cpu_supports("avx2"), 0, runAvx2, runScalar },
+        { "crc32c-hw",  __builtin_cpu_supports("sse4.2"), 0, runCrcHw, runCrcSw },
+#endif
+        { "crc32c-sw",  1, 1, runCrcSw, runCrcSw },
+    };
+    int nvariants = sizeof(variants) / sizeof(variants[0]);
+    unsigned char *data = malloc(65536 + 1);
+
+    if (data == NULL) {
+        fprintf(stderr, "Error: Memory allocation failed!\n");
+        return EXIT_FAILURE;
+    }
+    srand(1);
+    for (int i = 0; i < 65536 + 1; i++) {
+        data[i] = rand();
+    }
+
+    printf("%-10s", "size");
+    for (int v = 0; v < nvariants; v++) {
+        printf("%12s", variants[v].name);
+    }
+    printf("   [GB/s]\n");
+
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        printf("%-10zu", sizes[s]);
+        for (int v = 0; v < nvariants; v++) {
+            if (!variants[v].supported) {
+                printf("%12s", "-");
+                continue;
+            }
+            // Unaligned start as inside received packet, results have to match
+            if (variants[v].run(data + 1, sizes[s]) != variants[v].reference(data + 1, sizes[s])) {
+                printf("%12s", "MISMATCH");
+                continue;
+            }
+            size_t rounds = BENCH_BYTES / sizes[s];
+            if (variants[v].slow) {
+                rounds /= 32;    // Bitwise CRC would take minutes
+            }
+            volatile uint32_t sink = 0;
+            double start = now();
+            for (size_t r = 0; r < rounds; r++) {
+                sink += variants[v].run(data + 1, sizes[s]);
+            }
+            double elapsed = now() - start;
+            printf("%12.2f", rounds * sizes[s] / elapsed / 1e9);
+        }
+        printf("\n");
+    }
+    free(data);
+    return EXIT_SUCCESS;
+}
+
+/*** End of file checksum_bench.c ***/
@@ -0,0 +1,402 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             congestion.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file defining congestion controllers - Reno/NewReno,
+*        BBR-like model and none.
+*
+*******************************************************************/
+/**
+* @file congestion.c
+*
+* @brief Source file defining congestion controllers - Reno/NewReno,
+* @brief BBR-like model and none.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "congestion.h"
+
+// BBR gains and states
+#define BBR_HIGHGAIN   2.885       // 2/ln(2) - doubles sending rate each round
+#define BBR_CWNDGAIN   2.0
+#define BBR_CYCLE      8
+#define BBR_MINWINDOW  4
+
+/**
+ * Enum of BBR states.
+ */
+enum bbrstates {
+    BBR_STARTUP,   /**< enum Exponential search of bandwidth. */
+    BBR_DRAIN,     /**< enum Draining queue created during startup. */
+    BBR_PROBEBW    /**< enum Cycling around estimated bandwidth. */
+};
+
+// Pacing gains of bandwidth probing cycle
+static const double BBR_GAINS[BBR_CYCLE] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+/**
+ * Returns half of flight size for new slow start threshold.
+ * @param sample Event sample.
+ * @return Returns slow start threshold.
+ */
+static unsigned int halfFlight(TCcSample *sample) {
+    unsigned int half = sample->in_flight / 2;
+    return half > CC_MINWINDOW ? half : CC_MINWINDOW;
+}
+
+/*** Reno/NewReno ***/
+
+/**
+ * Initializes Reno controller - slow start from initial window.
+ * @param cc Pointer to congestion control.
+ */
+static void renoInit(TCongestion *cc) {
+    cc->cwnd = CC_INITWINDOW;
+    cc->ssthresh = UINT_MAX;
+    cc->acked_cnt = 0;
+    cc->recover = 0;
+    cc->in_recovery = 0;
+}
+
+/**
+ * Reno reaction on ack - slow start or congestion avoidance, window
+ * does not grow during fast recovery (NewReno).
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void renoAck(TCongestion *cc, TCcSample *sample) {
+    if (cc->in_recovery) {
+        if (sample->ack < cc->recover) {
+            return;             // Partial ack, stay in fast recovery
+        }
+        cc->in_recovery = 0;    // Everything sent before loss is acknowledged
+    }
+    // Window is not used fully - does not grow (application limited)
+    if (sample->in_flight + sample->acked < cc->cwnd) {
+        return;
+    }
+
+    if (cc->cwnd < cc->ssthresh) {   // Slow start
+        cc->cwnd += sample->acked;
+    } else {                         // Congestion avoidance - one packet per window
+        cc->acked_cnt += sample->acked;
+        while (cc->acked_cnt >= cc->cwnd) {
+            cc->acked_cnt -= cc->cwnd;
+            cc->cwnd++;
+        }
+    }
+}
+
+/**
+ * Reno reaction on loss - halves window once per window of data (NewReno).
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void renoLoss(TCongestion *cc, TCcSample *sample) {
+    if (sample->ack < cc->recover) {
+        return;        // Loss of the same window was handled already
+    }
+    cc->ssthresh = halfFlight(sample);
+    cc->cwnd = cc->ssthresh;
+    cc->acked_cnt = 0;
+    cc->recover = sample->next_seq;
+    cc->in_recovery = 1;
+}
+
+/**
+ * Reno reaction on timeout - slow start from one packet.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void renoTimeout(TCongestion *cc, TCcSample *sample) {
+    cc->ssthresh = halfFlight(sample);
+    cc->cwnd = 1;
+    cc->acked_cnt = 0;
+    cc->recover = sample->next_seq;
+    cc->in_recovery = 0;
+}
+
+/**
+ * Returns congestion window of window based controllers.
+ * @param cc Pointer to congestion control.
+ * @return Returns max number of packets in flight.
+ */
+static unsigned int renoWindow(TCongestion *cc) {
+    return cc->cwnd;
+}
+
+/**
+ * Returns pacing rate of window based controllers - sending is not paced.
+ * @param cc Pointer to congestion control.
+ * @return Returns rate in B/s or 0 whether is sending not paced.
+ */
+static double renoPacingRate(TCongestion *cc) {
+    (void)cc;
+    return 0;
+}
+
+/*** BBR-like ***/
+
+/**
+ * Initializes BBR-like controller in startup state.
+ * @param cc Pointer to congestion control.
+ */
+static void bbrInit(TCongestion *cc) {
+    memset(cc->bw, 0, sizeof(cc->bw));
+    cc->cwnd = CC_INITWINDOW;
+    cc->state = BBR_STARTUP;
+    cc->btl_bw = 0;
+    cc->full_bw = 0;
+    cc->full_bw_cnt = 0;
+    cc->min_rtt = 0;
+    cc->min_rtt_stamp = 0;
+    cc->round_count = 0;
+    cc->round_end = 0;
+    cc->round_stamp = 0;
+    cc->delivered = 0;
+    cc->round_delivered = 0;
+    cc->cycle = 0;
+    cc->prior_cwnd = 0;
+}
+
+/**
+ * Returns bandwidth-delay product in packets.
+ * @param cc Pointer to congestion control.
+ * @param gain Multiplier.
+ * @return Returns estimated packets inside the pipe.
+ */
+static unsigned int bbrBdp(TCongestion *cc, double gain) {
+    return (unsigned int)(gain * cc->btl_bw * cc->min_rtt / 1000000);
+}
+
+/**
+ * Ends round trip - takes delivery rate sample and moves state machine.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void bbrRound(TCongestion *cc, TCcSample *sample) {
+    int64_t interval = sample->now - cc->round_stamp;
+
+    if (interval > 0) {   // Max filter over last rounds
+        cc->round_count++;
+        cc->bw[cc->round_count % CC_BWROUNDS] =
+            (double)(cc->delivered - cc->round_delivered) * 1000000 / interval;
+        cc->btl_bw = 0;
+        for (int i = 0; i < CC_BWROUNDS; i++) {
+            if (cc->bw[i] > cc->btl_bw) cc->btl_bw = cc->bw[i];
+        }
+    }
+
+    if (cc->state == BBR_STARTUP) {   // Pipe is full whether bandwidth stops growing
+        if (cc->btl_bw >= cc->full_bw * 1.25) {
+            cc->full_bw = cc->btl_bw;
+            cc->full_bw_cnt = 0;
+        } else if (++cc->full_bw_cnt >= 3) {
+            cc->state = BBR_DRAIN;
+        }
+    } else if (cc->state == BBR_PROBEBW) {
+        cc->cycle = (cc->cycle + 1) % BBR_CYCLE;
+    }
+
+    cc->round_end = sample->next_seq;
+    cc->round_stamp = sample->now;
+    cc->round_delivered = cc->delivered;
+}
+
+/**
+ * BBR reaction on ack - updates path model and sets window to its
+ * bandwidth-delay product.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void bbrAck(TCongestion *cc, TCcSample *sample) {
+    cc->delivered += sample->acked;
+
+    // Min filter of RTT, old minimum expires
+    if (sample->rtt > 0 && (cc->min_rtt == 0 || sample->rtt <= cc->min_rtt ||
+                            sample->now - cc->min_rtt_stamp > CC_RTTWINDOW)) {
+        cc->min_rtt = sample->rtt;
+        cc->min_rtt_stamp = sample->now;
+    }
+
+    if (cc->round_stamp == 0) {             // First round
+        cc->round_end = sample->next_seq;
+        cc->round_stamp = sample->now;
+        cc->round_delivered = cc->delivered;
+    } else if (sample->ack >= cc->round_end) {
+        bbrRound(cc, sample);
+    }
+
+    if (cc->state == BBR_DRAIN && sample->in_flight <= bbrBdp(cc, 1)) {
+        cc->state = BBR_PROBEBW;
+        cc->cycle = rand() % (BBR_CYCLE - 1);   // Random phase, never starts by draining
+        if (cc->cycle > 0) cc->cycle++;
+    }
+
+    if (cc->prior_cwnd) {   // Recovered from timeout
+        if (cc->cwnd < cc->prior_cwnd) cc->cwnd = cc->prior_cwnd;
+        cc->prior_cwnd = 0;
+    }
+
+    // Window follows the model, it grows by acked packets towards target
+    unsigned int target = bbrBdp(cc, cc->state == BBR_PROBEBW ? BBR_CWNDGAIN : BBR_HIGHGAIN);
+    if (cc->state != BBR_STARTUP) {
+        cc->cwnd = cc->cwnd + sample->acked < target ? cc->cwnd + sample->acked : target;
+    } else if (cc->cwnd < target || cc->delivered < CC_INITWINDOW || cc->btl_bw == 0) {
+        if (sample->in_flight + sample->acked >= cc->cwnd) {   // Not application limited
+            cc->cwnd += sample->acked;
+        }
+    }
+    if (cc->cwnd < BBR_MINWINDOW) {
+        cc->cwnd = BBR_MINWINDOW;
+    }
+}
+
+/**
+ * BBR reaction on loss - model is driven by delivery rate, not by loss.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void bbrLoss(TCongestion *cc, TCcSample *sample) {
+    (void)cc; (void)sample;   // Model is driven by delivery rate, not by loss
+}
+
+/**
+ * BBR reaction on timeout - sends one packet until next ack, then
+ * window before timeout is restored.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void bbrTimeout(TCongestion *cc, TCcSample *sample) {
+    (void)sample;
+    if (!cc->prior_cwnd) {
+        cc->prior_cwnd = cc->cwnd;
+    }
+    cc->cwnd = 1;
+}
+
+/**
+ * Returns congestion window of BBR-like controller.
+ * @param cc Pointer to congestion control.
+ * @return Returns max number of packets in flight.
+ */
+static unsigned int bbrWindow(TCongestion *cc) {
+    return cc->cwnd;
+}
+
+/**
+ * Returns pacing rate of BBR-like controller - gain of current state
+ * multiplied by bottleneck bandwidth.
+ * @param cc Pointer to congestion control.
+ * @return Returns rate in B/s or 0 whether is sending not paced.
+ */
+static double bbrPacingRate(TCongestion *cc) {
+    double gain = cc->state == BBR_STARTUP ? BBR_HIGHGAIN :
+                  cc->state == BBR_DRAIN ? 1 / BBR_HIGHGAIN : BBR_GAINS[cc->cycle];
+
+    if (cc->btl_bw == 0) {   // No estimate yet - initial window per RTT
+        return cc->min_rtt ? gain * cc->cwnd * cc->mss * 1000000.0 / cc->min_rtt : 0;
+    }
+    return gain * cc->btl_bw * cc->mss;
+}
+
+/*** none ***/
+
+/**
+ * Initializes controller without congestion control - unlimited window.
+ * @param cc Pointer to congestion control.
+ */
+static void noneInit(TCongestion *cc) {
+    cc->cwnd = UINT_MAX;
+}
+
+/**
+ * Ignores event.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+static void noneEvent(TCongestion *cc, TCcSample *sample) {
+    (void)cc; (void)sample;
+}
+
+/**
+ * Known controllers.
+ */
+static const TCcOps CONTROLLERS[] = {
+    { "reno", renoInit, renoAck, renoLoss, renoTimeout, renoWindow, renoPacingRate },
+    { "bbr",  bbrInit,  bbrAck,  bbrLoss,  bbrTimeout,  bbrWindow,  bbrPacingRate },
+    { "none", noneInit, noneEvent, noneEvent, noneEvent, renoWindow, renoPacingRate }
+};
+
+/**
+ * Initializes congestion control by controller name.
+ * @param cc Pointer to congestion control.
+ * @param name Name of controller - reno, bbr or none.
+ * @param mss Max data size of packet in bytes.
+ * @return Return 1 on success or 0 on unknown controller.
+ */
+int initCongestion(TCongestion *cc, const char *name, unsigned int mss) {
+    for (unsigned int i = 0; i < sizeof(CONTROLLERS) / sizeof(CONTROLLERS[0]); i++) {
+        if (strcmp(CONTROLLERS[i].name, name) == 0) {
+            cc->ops = &CONTROLLERS[i];
+            cc->mss = mss;
+            cc->ops->init(cc);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Informs controller about newly acknowledged packets.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccAck(TCongestion *cc, TCcSample *sample) {
+    cc->ops->on_ack(cc, sample);
+}
+
+/**
+ * Informs controller about lost packet reported by receiver.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccLoss(TCongestion *cc, TCcSample *sample) {
+    cc->ops->on_loss(cc, sample);
+}
+
+/**
+ * Informs controller about retransmission timeout.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccTimeout(TCongestion *cc, TCcSample *sample) {
+    cc->ops->on_rto(cc, sample);
+}
+
+/**
+ * Returns congestion window.
+ * @param cc Pointer to congestion control.
+ * @return Returns max number of packets in flight.
+ */
+unsigned int ccWindow(TCongestion *cc) {
+    return cc->ops->cwnd(cc);
+}
+
+/**
+ * Returns pacing rate.
+ * @param cc Pointer to congestion control.
+ * @return Returns rate in B/s or 0 whether is sending not paced.
+ */
+double ccPacingRate(TCongestion *cc) {
+    return cc->ops->pacing_rate(cc);
+}
+
+/*** End of file congestion.c ***/
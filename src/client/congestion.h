@@ -0,0 +1,132 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             congestion.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file of pluggable congestion control - TCongestion
+*        struture, controller interface and its methods.
+*
+*******************************************************************/
+/**
+* @file congestion.h
+*
+* @brief Header file of pluggable congestion control - TCongestion
+* @brief struture, controller interface and its methods.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef CONGESTION_H_
+#define CONGESTION_H_
+
+#include <stdint.h>
+
+// Congestion windows in packets
+#define CC_INITWINDOW  10          // Initial window (RFC 6928)
+#define CC_MINWINDOW   2           // Window after loss never falls below
+#define CC_BWROUNDS    10          // Length of BBR bandwidth filter in rounds
+#define CC_RTTWINDOW   10000000    // Length of BBR min RTT filter in us
+
+/**
+ * Event sample passed to controller, all times are in us.
+ */
+typedef struct {
+    unsigned int ack;        /**< cumulative ack - first unacked sequence, lost sequence on loss */
+    unsigned int acked;      /**< number of newly acknowledged packets */
+    unsigned int in_flight;  /**< number of unacknowledged packets */
+    unsigned int next_seq;   /**< next sequence to be sent */
+    long rtt;                /**< RTT sample, 0 whether is unavailable */
+    int64_t now;             /**< time of event */
+} TCcSample;
+
+typedef struct TCongestion TCongestion;
+
+/**
+ * Congestion controller interface.
+ */
+typedef struct {
+    const char *name;                                           /**< name used by -c option */
+    void (*init)(TCongestion *cc);                              /**< initializes controller state */
+    void (*on_ack)(TCongestion *cc, TCcSample *sample);         /**< new packets acknowledged */
+    void (*on_loss)(TCongestion *cc, TCcSample *sample);        /**< loss reported by NACK/SACK */
+    void (*on_rto)(TCongestion *cc, TCcSample *sample);         /**< retransmission timeout */
+    unsigned int (*cwnd)(TCongestion *cc);                      /**< congestion window in packets */
+    double (*pacing_rate)(TCongestion *cc);                     /**< sending rate in B/s, 0 unlimited */
+} TCcOps;
+
+/**
+ * Congestion control structure - state of all controllers.
+ */
+struct TCongestion {
+    const TCcOps *ops;             /**< used controller */
+    unsigned int mss;              /**< max data size of packet in bytes */
+    unsigned int cwnd;             /**< congestion window in packets */
+    unsigned int ssthresh;         /**< slow start threshold (Reno) */
+    unsigned int acked_cnt;        /**< packets acked since last window increase (Reno) */
+    unsigned int recover;          /**< end of fast recovery - next_seq on loss (NewReno) */
+    int in_recovery;               /**< 1 whether is controller in fast recovery (NewReno) */
+    int state;                     /**< model state (BBR) */
+    double bw[CC_BWROUNDS];        /**< max delivery rate of last rounds in packets/s (BBR) */
+    double btl_bw;                 /**< estimated bottleneck bandwidth in packets/s (BBR) */
+    double full_bw;                /**< bandwidth when pipe was considered as growing (BBR) */
+    unsigned int full_bw_cnt;      /**< rounds without bandwidth growth (BBR) */
+    long min_rtt;                  /**< min RTT, 0 whether is unknown (BBR) */
+    int64_t min_rtt_stamp;         /**< time of min RTT measurement (BBR) */
+    unsigned int round_count;      /**< number of passed rounds (BBR) */
+    unsigned int round_end;        /**< sequence which ends current round (BBR) */
+    int64_t round_stamp;           /**< start time of current round (BBR) */
+    uint64_t delivered;            /**< number of delivered packets (BBR) */
+    uint64_t round_delivered;      /**< delivered packets on round start (BBR) */
+    unsigned int cycle;            /**< index of gain cycle (BBR) */
+    unsigned int prior_cwnd;       /**< window before timeout, 0 whether is not saved (BBR) */
+};
+
+/**
+ * Initializes congestion control by controller name.
+ * @param cc Pointer to congestion control.
+ * @param name Name of controller - reno, bbr or none.
+ * @param mss Max data size of packet in bytes.
+ * @return Return 1 on success or 0 on unknown controller.
+ */
+int initCongestion(TCongestion *cc, const char *name, unsigned int mss);
+
+/**
+ * Informs controller about newly acknowledged packets.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccAck(TCongestion *cc, TCcSample *sample);
+
+/**
+ * Informs controller about lost packet reported by receiver.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccLoss(TCongestion *cc, TCcSample *sample);
+
+/**
+ * Informs controller about retransmission timeout.
+ * @param cc Pointer to congestion control.
+ * @param sample Event sample.
+ */
+void ccTimeout(TCongestion *cc, TCcSample *sample);
+
+/**
+ * Returns congestion window.
+ * @param cc Pointer to congestion control.
+ * @return Returns max number of packets in flight.
+ */
+unsigned int ccWindow(TCongestion *cc);
+
+/**
+ * Returns pacing rate.
+ * @param cc Pointer to congestion control.
+ * @return Returns rate in B/s or 0 whether is sending not paced.
+ */
+double ccPacingRate(TCongestion *cc);
+
+#endif /* CONGESTION_H_ */
+
+/*** End of file congestion.h ***/
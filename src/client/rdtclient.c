@@ -16,45 +16,86 @@
 * @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
 */
  
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#define _GNU_SOURCE
 #include <getopt.h>
 #include <string.h>
 #include <fcntl.h>
 #include <stdarg.h>
 #include "../libs/udt.h"
 #include "../libs/rdt.h"
+#include "../libs/evloop.h"
+#include "../libs/pool.h"
+#include "../libs/lz.h"
 #include "snd_window.h"
+#include "rtt.h"
+#include "congestion.h"
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <time.h>
 #include <sys/types.h>
-#include <signal.h>
-#include <time.h>
+#include <sys/uio.h>
+#include <sys/random.h>
 
-// Max length of accpeting line from stdin - but everything after 80 char will be removed
-#define MAXLINE    500
+// Size of chunk read from stdin at once
+#define STDIN_CHUNK (64 * 1024)
+// Max number of packet buffers filled by one read of stdin
+#define INPUT_BUFFERS 64
 
-// Packet size
-// In real only 90 - just for sure due to adding some info to header in future
-#define PACKETSIZE 100
-// Length of sending data
-#define DATASIZE    80
+// Recieving packet size
+#define PACKETSIZE ACK_PACKETSIZE
 
-// Delay in ms, when will be checked whether is any packet lost - timeout
-#define RETRY      150
-// Delay after which is packet considered as lost
+// Delay in ms after which is packet considered as lost - before first RTT sample
 #define LINKDELAY  600
 
+// Time in us for which can be pacing ahead - allows small bursts at high rates
+#define PACE_SLACK 250
+
+// Number of packets sent before server answers SYN - data of the first flight
+#define SYN_WINDOW 10
+
+// Number of FIN retransmissions after which is server considered as lost
+#define FIN_RETRIES 8
+
+// Number of SYN retransmissions after which is server considered as lost
+#define SYN_RETRIES 6
+
+// Number of retransmission timeouts in row after which is server considered as lost
+#define DATA_RETRIES 12
+
+// Number of later packets recieved behind hole after which is hole resent at once
+#define DUPTHRESH  3
+
+// Compressed data have to be at least 1/LZ_SAVING shorter, otherwise are sent as they are
+#define LZ_SAVING  8
+// Max number of packets sent uncompressed after failed compression
+#define LZ_SKIPMAX 1024
+
+// Max delay in ms of partial packet waiting for more data - coalescing
+#define NAGLE_DELAY 5
+
 /**
  * Enum of all handled errors.
  */
 enum errors {
     E_MALLOC,       /**< enum Memory allocation error. */
     E_UDTSEND,      /**< enum Some error caused fail of sending current packet. */
-    E_BADPARAMS     /**< enum Bad run parameters from cmd-line. */
+    E_BADPARAMS,    /**< enum Bad run parameters from cmd-line. */
+    E_WINDOWSIZE,   /**< enum Window size out of range. */
+    E_DATASIZE,     /**< enum Data size out of range. */
+    E_READ,         /**< enum Reading from stdin failed. */
+    E_CONGESTION,   /**< enum Unknown congestion control. */
+    E_EVLOOP,       /**< enum Event loop failed. */
+    E_NEGOTIATE,    /**< enum Server accepts only smaller packets than were sent. */
+    E_FIN,          /**< enum Server did not confirm end of transfer. */
+    E_SYN,          /**< enum Server did not answer SYN. */
+    E_REFUSED,      /**< enum Server refused connection. */
+    E_RESET,        /**< enum Server does not know established connection. */
+    E_DATA,         /**< enum Server did not acknowledge data. */
+    E_ARQ,          /**< enum Unknown ARQ mode. */
+    E_FEC           /**< enum FEC block size out of range. */
 };
 
 /**
@@ -63,7 +104,20 @@ enum errors {
 const char* ERRORS[] = {
     "Error: Memory allocation failed!\n",             // E_MALLOC
     "Error: Unable send packet.\n",                   // E_UDTSEND
-    "Error: Missing source or destination port!\n"    // E_BADPARAMS
+    "Error: Missing source or destination port!\n",   // E_BADPARAMS
+    "Error: Window size must be 1 - 65536!\n",         // E_WINDOWSIZE
+    "Error: Data size must be 1 - 65491!\n",           // E_DATASIZE
+    "Error: Unable read data from stdin.\n",           // E_READ
+    "Error: Congestion control must be reno, bbr or none!\n", // E_CONGESTION
+    "Error: Event loop failed.\n",                     // E_EVLOOP
+    "Error: Data size is not accepted by server!\n",   // E_NEGOTIATE
+    "Error: Server did not confirm end of transfer!\n", // E_FIN
+    "Error: Server does not answer!\n",                 // E_SYN
+    "Error: Server refused connection!\n",             // E_REFUSED
+    "Error: Connection was reset by server!\n",        // E_RESET
+    "Error: Server does not acknowledge data!\n",      // E_DATA
+    "Error: ARQ mode must be gbn or sr!\n",             // E_ARQ
+    "Error: FEC block size must be 1 - 64!\n"           // E_FEC
 };
 
 /**
@@ -71,7 +125,8 @@ const char* ERRORS[] = {
  */
 enum msgs {
     MSG_MANYPARAMS,   /**< enum Many run params specified. */
-    MSG_USAGE         /**< enum Usage message. */
+    MSG_USAGE,        /**< enum Usage message. */
+    MSG_NOGSO         /**< enum Segmentation offload unsupported. */
 };
 
 /**
@@ -79,33 +134,85 @@ enum msgs {
  */
 const char *MSGS[] = {
     "Warning: Too many options/arguments!\n",             // MSG_MANYPARAMS
-    "Usage: rdtclient -s source_port -d dest_port\n"      // MSG_USAGE
+    "Usage: rdtclient [-s source_port] [-d dest_port] [-w window_size] [-p data_size] [-c reno|bbr|none] [-r rate] [-m gbn|sr] [-f fec_block] [-z]\n                 [-t nagle_delay] [-n] [-g] [-k]\n",      // MSG_USAGE
+    "Warning: Segmentation offload is not supported!\n"  // MSG_NOGSO
 };
 
-char PACKET_BUFFER[PACKETSIZE];        
+char PACKET_BUFFER[PACKETSIZE] __attribute__((aligned(PACKET_ALIGN))); /**< Packet buffer for preparing control packets */
+char FEC_BUFFER[DATA_OFFSET + MAX_DATASIZE]; /**< Parity packet of current block */
+TPool pool;                          /**< pool of data packet buffers */
 
 TWindow window;                      /**< sliding window struture */
 in_addr_t dest_addr = 0x7f000001;    /**< destination address - only localhost */
 in_port_t src_port = 4030;              /**< local incomming port */
 in_port_t dest_port = 4040;             /**< destination port - where to send */
 unsigned int cnt_seq = 0;            /**< current sequence to send */
-sigset_t sigmask;                    /**< signal mask */
-struct itimerval timer;              /**< timer structure */
+unsigned int conn_id = 0;            /**< ID of connection, server tells clients apart by it */
+int syn_nacked = 0;                  /**< is set to 1 whether data came before SYN, they are resent after answer */
+int established = 0;                 /**< is set to 1 whether server answered SYN */
+unsigned int peer_window = SYN_WINDOW; /**< max packets in flight accepted by server */
+time_t syn_stamp = 0;                /**< time in us when was SYN sent */
+time_t syn_deadline = 0;             /**< time in us when SYN is repeated, 0 whether is not waiting */
+unsigned int syn_sends = 0;          /**< number of sent SYNs */
+time_t fin_deadline = 0;             /**< time in us when FIN is repeated, 0 whether is not waiting */
+unsigned int fin_sends = 0;          /**< number of sent FINs */
+unsigned int data_timeouts = 0;      /**< number of retransmission timeouts in row, acknowledged data reset it */
+unsigned int dup_acks = 0;           /**< number of ACKs repeating the first unacked sequence */
+unsigned int fast_seq = 0;           /**< sequences before were already checked by fast retransmit */
+unsigned int window_size = WINDOWSIZE; /**< max size of sliding window, it grows up to it */
+unsigned int data_size = DEF_DATASIZE; /**< max length of data inside one packet */
+unsigned int max_data_size = DEF_DATASIZE; /**< data size proposed by SYN, packets grow to accepted one */
+TEvLoop loop;                        /**< event loop */
+int rto_timer;                       /**< retransmission timer descriptor */
+time_t timer_deadline = 0;           /**< time in us when timer expires, 0 whether is not running */
+TRtt rtt;                            /**< RTT estimator */
+TCongestion cc;                      /**< congestion control */
+char *cc_name = "reno";              /**< name of congestion controller */
+unsigned long pace_rate = 0;         /**< pacing rate in B/s, 0 takes rate from congestion control */
+int pace_timer;                      /**< pacing timer descriptor */
+time_t pace_next = 0;                /**< time in us when next packet can be sent */
+int pace_armed = 0;                  /**< is set to 1 whether pacing timer is running */
+int gso = 0;                         /**< is set to 1 whether is segmentation offload used */
+unsigned short sum_flag = 0;         /**< CRC whether are packets protected by CRC32C */
+int selective = 1;                   /**< is set to 1 for Selective Repeat, 0 for Go-Back-N */
+unsigned int fec_block = 0;          /**< number of data packets protected by one parity, 0 disables FEC */
+unsigned int fec_count = 0;          /**< number of data packets inside current parity */
+unsigned short fec_lens = 0;         /**< XOR of data lengths of current block */
+unsigned short fec_flags = 0;        /**< XOR of data flags of current block */
+unsigned short fec_len = 0;          /**< length of the longest packet of current block */
+unsigned int dup_thresh = DUPTHRESH; /**< number of later packets after which is hole resent */
+int lz = 0;                          /**< is set to 1 whether are data compressed */
+unsigned int lz_skip = 0;            /**< number of packets sent uncompressed before next attempt */
+unsigned int lz_backoff = 0;         /**< the last value of lz_skip, it doubles with each failure */
 int udt;                             /**< socket descriptor */
+char *input[INPUT_BUFFERS];          /**< packet buffers filled from stdin behind header */
+unsigned short input_lens[INPUT_BUFFERS]; /**< data lengths of filled buffers */
+unsigned int input_pos = 0;          /**< index of first unsent buffer */
+unsigned int input_cnt = 0;          /**< number of filled buffers */
+unsigned int input_max = 1;          /**< number of buffers filled by one read */
+int input_eof = 0;                   /**< is set to 1 whether stdin reached EOF */
+char *hold = NULL;                   /**< partial packet buffer waiting for more data, NULL whether is not */
+unsigned int hold_len = 0;           /**< data length of waiting buffer */
+int hold_armed = 0;                  /**< is set to 1 whether coalescing timer is running */
+int nagle_timer;                     /**< coalescing timer descriptor */
+unsigned int nagle_delay = NAGLE_DELAY; /**< max delay in ms of partial packet */
+int nodelay = 0;                     /**< is set to 1 whether are partial packets sent at once */
+unsigned int out_seqs[UDT_BATCH];    /**< sequences of packets waiting for batch send */
+unsigned int out_count = 0;          /**< number of packets waiting for batch send */
+int send_blocked = 0;                /**< is set to 1 whether socket buffer is full, sending waits until it is writable */
 
 /**
- * Starts timer.
+ * Sets retransmission timer to expire at the specified time.
+ * @param deadline Time in us, 0 disarms timer.
  */
-void startTimer() {
-    sigprocmask(SIG_UNBLOCK, &sigmask, NULL);
-    setitimer(ITIMER_REAL, &timer, NULL);
-}
-
-/**
- * Stops timer - block SIGALRM signal.
- */
-void stopTimer() {
-    sigprocmask(SIG_BLOCK, &sigmask, NULL);
+void armTimer(time_t deadline) {
+    time_t delay = 0;
+    if (deadline) {
+        delay = deadline - ev_now();
+        if (delay < 1) delay = 1;   // Zero value would disarm timer
+    }
+    timer_deadline = deadline;
+    ev_timer_arm(rto_timer, delay);
 }
 
 /**
@@ -115,261 +222,976 @@ void stopTimer() {
 void printError(int error) {
     fprintf(stderr, "%s", ERRORS[error]);
     perror("Caused: ");
-    stopTimer();
 	destroyWindow(&window);
     exit(1);
 }
 
 /**
- * Allocates memory for packet and makes new one with specified data.
- * @param data Data which will be appedned to the packet. 
+ * Makes new packet from pool buffer which has data already placed behind
+ * header, only header is written.
+ * @param buffer Pool buffer with data at DATA_OFFSET. 
+ * @param len Length of data, at most data_size.
+ * @param flags Data flags - LZ.
  */
-char *makeDataPacket(char * data) {
+char *makeDataPacket(char *buffer, unsigned short len, unsigned short flags) {
     // Praparing packet to send
     RDTPacket packet;
     packet.seq = cnt_seq;
-    packet.len = strlen(data);
-    packet.data = data;
-    packet.flags = 0x00;
+    packet.conn = conn_id;
+    packet.len = len;
+    packet.data = &buffer[DATA_OFFSET];
+    packet.flags = flags | sum_flag;
     
-    // Correcting data length - only 80 chars to send
-    if (packet.len > DATASIZE) {
-        packet.len = DATASIZE; 
-    }
+    return encodePacket(packet, buffer);  
+}
+
+/**
+ * Compresses data of input buffer into another pool buffer whether it saves
+ * enough space. Each failure turns compression off for twice as many packets,
+ * so incompressible input costs almost nothing.
+ * @param buffer Pool buffer with data at DATA_OFFSET, it returns into pool whether is replaced.
+ * @param len Pointer to length of data, it is updated.
+ * @param flags Pointer to data flags, LZ is set whether are data compressed.
+ * @return Returns pool buffer with data to send.
+ */
+char *compressData(char *buffer, unsigned short *len, unsigned short *flags) {
+    char *out;
+    unsigned int n;
     
-    // Making final packet from packet structure
-    char *_packet = makePacket(packet);
-    if(_packet == NULL) {
+    if (lz_skip > 0) {
+        lz_skip--;
+        return buffer;
+    }
+    if ((out = pool_alloc(&pool)) == NULL) {
         printError(E_MALLOC);
     }
+    n = lz_compress(&buffer[DATA_OFFSET], *len, &out[DATA_OFFSET], *len - *len / LZ_SAVING);
+    if (n == 0) {   // Incompressible
+        pool_free(&pool, out);
+        lz_backoff = lz_backoff ? 2 * lz_backoff : 1;
+        if (lz_backoff > LZ_SKIPMAX) lz_backoff = LZ_SKIPMAX;
+        lz_skip = lz_backoff;
+        return buffer;
+    }
+    pool_free(&pool, buffer);
+    lz_backoff = 0;
+    *len = n;
+    *flags = LZ;
+    return out;
+}
+
+/**
+ * Returns pacing rate - from run params or from congestion control.
+ * @return Returns rate in B/s or 0 whether is sending not paced.
+ */
+double pacingRate() {
+    return pace_rate ? pace_rate : ccPacingRate(&cc);
+}
+
+/**
+ * Moves time of next sending by transmission time of packet.
+ * @param len Length of sent packet.
+ */
+void pacePacket(unsigned int len) {
+    double rate = pacingRate();
+    if (rate > 0) {
+        time_t now = ev_now();
+        if (pace_next < now) {   // Idle sender does not save budget
+            pace_next = now;
+        }
+        pace_next += (time_t)(len * 1000000.0 / rate);
+    }
+}
+
+/**
+ * Checks whether pacing allows sending of next packet, otherwise
+ * pacing timer is started.
+ * @return Return 1 whether packet can be sent now else 0.
+ */
+int paceAllows() {
+    if (pacingRate() <= 0) {
+        return 1;
+    }
+    time_t now = ev_now();
+    if (pace_next <= now + PACE_SLACK) {
+        return 1;
+    }
+    if (!pace_armed) {
+        ev_timer_arm(pace_timer, pace_next - now);
+        pace_armed = 1;
+    }
+    return 0;
+}
+
+/**
+ * Sends all waiting packets to remote host by one batch. Packets acknowledged
+ * meanwhile are skipped, packets not accepted by full socket buffer stay
+ * waiting and socket is watched until it is writable.
+ */
+void flushPackets() {
+    udt_datagram dgrams[UDT_BATCH];
+    unsigned int seqs[UDT_BATCH];
+    unsigned int n = 0;
+    int sent = 0;
+    char *packet;
+
+    for (unsigned int i = 0; i < out_count; i++) {
+        if ((packet = getPacket(&window, out_seqs[i])) != NULL) {
+            dgrams[n].buff = packet;
+            dgrams[n].nbytes = packetLen(packet);
+            dgrams[n].port = 0;   // Connected socket
+            seqs[n++] = out_seqs[i];
+        }
+    }
+    if (n > 0 && (sent = gso ? udt_send_gso(udt, dgrams, n) : udt_send_batch(udt, dgrams, n)) < 0) {
+        printError(E_UDTSEND);   // Sending failed
+    }
     
-    return _packet;  
+    // Unsent tail is sent first when socket is writable again
+    out_count = n - sent;
+    memmove(out_seqs, &seqs[sent], out_count * sizeof(unsigned int));
+    if (out_count > 0 && !send_blocked) {
+        send_blocked = 1;
+        ev_modify(&loop, udt, EV_READ | EV_WRITE);
+    }
 }
 
 /**
- * Sends packet to remote host.
- * @param packet Packet to send. 
+ * Sends packet to remote host. Packet waits for batch send until
+ * flushPackets is called or the batch is full.
+ * @param packet Packet to send, it has to be stored inside window before flush. 
  */
 void sendPacket(char *packet) {
     if (packet != NULL) {  // Frist check whether there is any packet
-        if (!udt_send(udt, dest_addr, dest_port, packet, packetLen(packet))) {
-        	printError(E_UDTSEND);   // Sending failed
-        }
-        // After success - store send time
-        struct timeval sended;
-        gettimeofday(&sended, NULL);
-        window.timestamps[seqNumber(packet) % WINDOWSIZE] = sended.tv_sec * 1000 + sended.tv_usec/1000;
-    }
-}
-
-/**
- * Timer handler - resends packets from window which are probably lost.
- * @param packet Packet to send. 
- */
-void resendPackets(int sig) {
-    if (sig == SIGALRM) {
-        // Getting current time
-        struct timeval request;
-        gettimeofday(&request, NULL);
-        time_t timestamp = request.tv_sec * 1000 + request.tv_usec/1000;
-        register unsigned int offset;
-
-        // Sending packet only from non empty window    
-        if (!isEmpty(&window)) {
-            // Go through all sequences inside window
-            for (int i = 0; i < WINDOWSIZE; i++) {
-                offset = (window.first_seq + i) % WINDOWSIZE;
-                
-                // Resend packet or finish whether is window empty or there is still time
-                if (// Abs just due to change of sys time to the past
-                    (abs(timestamp - window.timestamps[offset]) > LINKDELAY)
-                    // Reached empty window sequece 
-                    && (window.packets[offset] != NULL)) {
-                    
-                        sendPacket(window.packets[offset]);
-                        
-                } else { // Still time or reached empty sequnce inside window
-                    break;
-                }
-            }
+        if (out_count == UDT_BATCH) {
+            flushPackets();
         }
-        
-    	// Re-install handler.
-    	signal(SIGALRM, resendPackets);
-	}
+        unsigned int seq = seqNumber(packet);
+        if (out_count < UDT_BATCH) {   // Full socket buffer - repeated by its timer
+            out_seqs[out_count++] = seq;
+        }
+        pacePacket(packetLen(packet));
+        // After success - store send time and (re)arm its timer
+        unsigned int offset = seq & window.mask;
+        window.timestamps[offset] = ev_now();
+        if (window.sends[offset] < UCHAR_MAX) {
+            window.sends[offset]++;
+        }
+        wheelAdd(&window.timers, offset, window.timestamps[offset],
+                 window.timestamps[offset] + rttTimeout(&rtt));
+        // Timer descriptor follows the earliest wheel deadline
+        time_t next = wheelNext(&window.timers);
+        if (timer_deadline == 0 || next < timer_deadline) {
+            armTimer(next);
+        }
+    }
 }
 
 /**
- * Sets interval delay to timer.
- * @param delay Delay of timer tick in ms. 
+ * Measures RTT of acknowledged packet, retransmitted packets are skipped (Karn's rule).
+ * @param seq Sequence number of acknowledged packet. 
+ * @return Returns measured RTT in us or 0 whether cannot be measured.
  */
-void setTimer(int delay) {
-	signal(SIGALRM, resendPackets);
+long sampleRtt(unsigned int seq) {
+    unsigned int offset = seq & window.mask;
+    long sample = 0;
+    if (getPacket(&window, seq) != NULL && window.sends[offset] == 1) {
+        sample = ev_now() - window.timestamps[offset];
+        rttSample(&rtt, sample);
+    }
+    return sample;
+}
 
-	timer.it_interval.tv_sec = delay / 1000; 	// sets an interval of the timer
-	timer.it_interval.tv_usec = (delay % 1000) * 1000;	
-	timer.it_value.tv_sec = delay / 1000;		// sets an initial value
-	timer.it_value.tv_usec = (delay % 1000) * 1000;
+/**
+ * Removes packets reported by SACK blocks of ACK/NACK packet from window.
+ * @param packet Recieved ACK/NACK packet. 
+ * @param high Sequence behind the highest recieved packet, it is raised by blocks. 
+ * @return Returns measured RTT in us or 0 whether cannot be measured.
+ */
+long processSack(char *packet, unsigned int *high) {
+    unsigned int start, end;
+    long sample = 0;
+    
+    for (int i = 0; i < sackCount(packet); i++) {
+        sackBlock(packet, i, &start, &end);
+        if (i == sackCount(packet) - 1) {  // Last block contains the newest packet
+            sample = sampleRtt(end - 1);
+        }
+        if (end > *high) {
+            *high = end;
+        }
+        removeRange(&window, start, end);
+    }
+    return sample;
+}
 
-	sigemptyset(&sigmask);
-	sigaddset(&sigmask, SIGALRM);
+/**
+ * Go-Back-N retransmission - resends all unacknowledged packets from
+ * the specified sequence, receiver dropped everything behind the lost one.
+ * @param seq First sequence to resend.
+ */
+void goBack(unsigned int seq) {
+    for (; seq < cnt_seq; seq++) {
+        sendPacket(getPacket(&window, seq));
+    }
 }
 
 /**
- * Proccesses run params. Returns 0/1 or finishes app in some cases.
- * @param argc Number of run params. 
- * @param argv Array with run params.
- * @return Return 0 on success or 1 on fail.    
+ * Fast retransmit - resends at once every unacknowledged packet behind which
+ * at least dup_thresh later packets were recieved, so loss is recovered
+ * in one RTT instead of timeout. Each packet is resent this way only before
+ * its first retransmission, repeated loss is left to retransmission timer.
+ * @param high Sequence behind the highest recieved packet. 
+ * @return Returns 1 whether was any packet resent else 0.
  */
-// int readParams(int argc, char **argv) {
-// 	char ch;
-// 	while ((ch = getopt(argc,argv,"s:d:")) != -1) {
-// 		switch(ch) {
-// 		case 's':  // Source port
-// 			src_port = atol(optarg);
-// 			break;
-// 		case 'd':  // Destination port
-// 			dest_port = atol(optarg);
-// 			break;
-// 		case '?':  // Unknown flag, print error
-// 			fprintf(stderr, "%s", MSGS[MSG_USAGE]);;
-//         }
-// 	}
-
-// 	// Missing params or bad params.
-// 	if (src_port == 0 || dest_port == 0) {
-// 		printError(E_BADPARAMS);
-// 	}
-	
-// 	// Many params
-//     if (argc > 5) {
-// 		fprintf(stderr, "%s", MSGS[MSG_MANYPARAMS]);
-// 	}
-// 	return 1;
-// }
+int fastRetransmit(unsigned int high) {
+    unsigned int offset;
+    int resent = 0;
+    
+    if (high > cnt_seq) {
+        high = cnt_seq;
+    }
+    if (!selective) {   // Go-Back-N - the whole window follows the first lost packet
+        offset = window.first_seq & window.mask;
+        if (!isEmpty(&window) && window.first_seq + dup_thresh < high && window.sends[offset] == 1) {
+            goBack(window.first_seq);
+            return 1;
+        }
+        return 0;
+    }
+    if (fast_seq < window.first_seq) {
+        fast_seq = window.first_seq;   // Acknowledged sequences are not checked
+    }
+    for (; fast_seq + dup_thresh < high; fast_seq++) {
+        offset = fast_seq & window.mask;
+        if (getPacket(&window, fast_seq) != NULL && window.sends[offset] == 1) {
+            sendPacket(window.packets[offset]);
+            resent = 1;
+        }
+    }
+    return resent;
+}
+
+/**
+ * Fills event sample for congestion control.
+ * @param sample Pointer to sample.
+ * @param seq Acknowledged or lost sequence.
+ * @param acked Number of newly acknowledged packets.
+ * @param rtt_sample Measured RTT in us or 0.
+ */
+void ccSample(TCcSample *sample, unsigned int seq, unsigned int acked, long rtt_sample) {
+    sample->ack = seq;
+    sample->acked = acked;
+    sample->in_flight = window.count;
+    sample->next_seq = cnt_seq;
+    sample->rtt = rtt_sample;
+    sample->now = ev_now();
+}
+
+/**
+ * Doubles full window up to max size and window accepted by server,
+ * pool reserves buffers for new slots by one slab.
+ */
+void enlargeWindow() {
+    unsigned int size = window.size * 2;
+    if (size > window_size) size = window_size;
+    if (size > peer_window) size = peer_window;
+    
+    if (!pool_reserve(&pool, size - window.size) || !growWindow(&window, size)) {
+        printError(E_MALLOC);
+    }
+}
+
+/**
+ * Checks whether new packet can be sent - window is not full and
+ * congestion control allows more packets in flight.
+ * @return Return 1 whether packet can be sent else 0.
+ */
+int canSend() {
+    if (send_blocked) {
+        return 0;   // New packets wait for socket buffer
+    }
+    if (!isAvailable(&window) && window.size < window_size && window.size < peer_window &&
+        window.count < ccWindow(&cc)) {
+        enlargeWindow();
+    }
+    return isAvailable(&window) && window.count < ccWindow(&cc) && window.count < peer_window;
+}
 
 /**
- * Closes transfer with rdtserver. 
+ * Sets max data size of packets and number of packet buffers filled by one read.
+ * @param size Max data size.
  */
-void closeConnection() {
-    // Prapare packet with END flag
+void setDataSize(unsigned int size) {
+    data_size = size;
+	input_max = STDIN_CHUNK / data_size;
+	if (input_max < 1) input_max = 1;
+	if (input_max > INPUT_BUFFERS) input_max = INPUT_BUFFERS;
+}
+
+/**
+ * Sends SYN with proposed connection parameters, it is repeated by
+ * retransmission timer until server answers.
+ */
+void sendSyn() {
+    if (syn_sends > SYN_RETRIES) {
+        printError(E_SYN);
+    }
+    
+    RDTParams params;
+    params.window = window_size;
+    params.data_size = max_data_size;
+    params.features = (selective ? FEAT_SR | FEAT_SACK : 0) | (sum_flag ? FEAT_CRC : 0) | (lz ? FEAT_LZ : 0);
+    params.fec_block = fec_block;
+    
     RDTPacket packet;
     packet.seq = 0;
+    packet.conn = conn_id;
+    packet.flags = SYN | sum_flag;
+    packet.data = &PACKET_BUFFER[DATA_OFFSET];
+    packet.len = synData(&params, packet.data);
+    char *_packet = encodePacket(packet, PACKET_BUFFER);
+    
+    // Server does not have to listen yet - SYN is repeated
+    if (!udt_send_conn(udt, _packet, packetLen(_packet)) && errno != ECONNREFUSED) {
+        printError(E_UDTSEND);
+    }
+    syn_sends++;
+    syn_stamp = ev_now();
+    syn_deadline = syn_stamp + rttTimeout(&rtt);
+    if (timer_deadline == 0 || syn_deadline < timer_deadline) {
+        armTimer(syn_deadline);
+    }
+}
+
+/**
+ * Processes answer to SYN - takes connection parameters accepted by server.
+ * @param packet Decoded answer.
+ */
+void processSynAck(RDTPacket *packet) {
+    RDTParams params;
+    
+    if (established || !parseSyn(packet, &params)) {   // Repeated answer
+        return;
+    }
+    if (syn_sends == 1) {   // RTT of repeated SYN is ambiguous (Karn's rule)
+        rttSample(&rtt, ev_now() - syn_stamp);
+    }
+    
+    // Packets of the first flight have at most MIN_DATASIZE - every server accepts them,
+    // the next ones grow to accepted size
+    if (params.data_size > max_data_size) {
+        params.data_size = max_data_size;
+    }
+    if (params.data_size < data_size && (cnt_seq > 0 || input_pos < input_cnt || hold != NULL)) {
+        printError(E_NEGOTIATE);   // Packets cannot be split
+    }
+    setDataSize(params.data_size);
+    cc.mss = data_size;   // Windows are counted by packets, size is used by pacing only
+    selective = (params.features & FEAT_SR) != 0;   // Server can refuse buffering
+    lz = lz && (params.features & FEAT_LZ);
+    if (params.fec_block != fec_block) {   // Server does not rebuild packets
+        fec_block = 0;
+    }
+    // Hole gets time to be rebuilt by parity of its block before it is resent
+    dup_thresh = fec_block ? DUPTHRESH + fec_block : DUPTHRESH;
+    peer_window = params.window;
+    established = 1;
+    syn_deadline = 0;
+    if (syn_nacked) {   // Server dropped data which overtook SYN
+        goBack(window.first_seq);
+    }
+}
+
+/**
+ * Chooses random ID of connection, zero is never used.
+ */
+void newConnId() {
+    do {
+        if (getrandom(&conn_id, sizeof(conn_id), 0) != sizeof(conn_id)) {
+            conn_id ^= ((unsigned int)getpid() * 2654435761u) ^ (unsigned int)ev_now();   // Old kernel
+        }
+    } while (conn_id == 0);
+}
+
+/**
+ * Starts connection again under new ID - server refused SYN because ID is
+ * used. Packets of the first flight are recoded and resent with new SYN,
+ * parity of current block is XOR of data only, so it stays valid.
+ */
+void restartSyn() {
+    newConnId();
+    for (unsigned int seq = window.first_seq; seq < cnt_seq; seq++) {
+        char *packet = getPacket(&window, seq);
+        if (packet != NULL) {
+            RDTHeader *header = (RDTHeader *)packet;
+            header->conn = htonl(conn_id);
+            header->sum = htonl(packetSum(packet, packetLen(packet)));
+        }
+    }
+    sendSyn();   // Retries of all IDs are counted together
+    goBack(window.first_seq);
+    flushPackets();
+}
+
+/**
+ * Sends parity of current block, it follows data of block. Parity is not
+ * stored inside window - lost parity is not repeated.
+ */
+void sendParity() {
+    if (fec_count == 0) {
+        return;
+    }
+    flushPackets();
+    
+    RDTPacket packet;
+    packet.seq = cnt_seq - fec_count;
+    packet.conn = conn_id;
+    packet.len = FEC_HEADER + fec_len;
+    packet.flags = FEC | sum_flag;
+    packet.data = &FEC_BUFFER[DATA_OFFSET];
+    fecData(fec_lens, fec_flags, fec_count, packet.data);
+    char *_packet = encodePacket(packet, FEC_BUFFER);
+    
+    pacePacket(packetLen(_packet));
+    if (!udt_send_conn(udt, _packet, packetLen(_packet)) && errno != ECONNREFUSED) {
+        printError(E_UDTSEND);
+    }
+    memset(&FEC_BUFFER[DATA_OFFSET + FEC_HEADER], 0, fec_len);
+    fec_count = 0;
+    fec_lens = 0;
+    fec_flags = 0;
+    fec_len = 0;
+}
+
+/**
+ * Adds new data packet into parity of current block, parity is sent
+ * whether is block complete.
+ * @param packet Data packet, its sequence has to follow the last protected one.
+ */
+void protectPacket(char *packet) {
+    unsigned short len = dataLen(packet);
+    
+    xorData(&FEC_BUFFER[DATA_OFFSET + FEC_HEADER], &packet[DATA_OFFSET], len);
+    fec_lens ^= len;
+    fec_flags ^= hasFlags(packet, LZ);
+    if (fec_len < len) {
+        fec_len = len;
+    }
+    fec_count++;
+}
+
+/**
+ * Starts waiting for answer to FIN, it is repeated after timeout.
+ */
+void finTimer() {
+    fin_deadline = ev_now() + rttTimeout(&rtt);
+    if (timer_deadline == 0 || fin_deadline < timer_deadline) {
+        armTimer(fin_deadline);
+    }
+}
+
+/**
+ * Sends FIN - end of transfer behind the last data packet. Server answers
+ * whether has delivered all data, FIN is repeated by retransmission timer
+ * only whether is window empty - data retransmissions come first.
+ */
+void sendFin() {
+    if (fin_sends > FIN_RETRIES) {
+        printError(E_FIN);
+    }
+    
+    RDTPacket packet;
+    packet.seq = cnt_seq;
+    packet.conn = conn_id;
     packet.len = 0;
     packet.data = NULL;
-    packet.flags = END;
+    packet.flags = FIN | sum_flag;
+    char *_packet = encodePacket(packet, PACKET_BUFFER);
     
-    // Creating packet
-    char *_packet = makePacket(packet);
-    if(_packet == NULL) {
-		printError(E_MALLOC);
+    if (!udt_send_conn(udt, _packet, packetLen(_packet)) && errno != ECONNREFUSED) {
+        printError(E_UDTSEND);
+    }
+    fin_sends++;
+    fin_deadline = 0;
+    if (isEmpty(&window)) {
+        finTimer();
+    }
+}
+
+/**
+ * Returns time when retransmission timer should expire.
+ * @return Returns the earliest of packet, SYN and FIN deadlines or 0 whether is nothing to wait for.
+ */
+time_t nextDeadline() {
+    time_t next = wheelNext(&window.timers);
+    if (syn_deadline && (next == 0 || syn_deadline < next)) {
+        next = syn_deadline;
+    }
+    if (fin_deadline && (next == 0 || fin_deadline < next)) {
+        next = fin_deadline;
+    }
+    return next;
+}
+
+/**
+ * Expiration handler of timer wheel - resends lost packet, Go-Back-N
+ * resends whole window after all expirations.
+ * @param offset Ring offset of packet. 
+ * @param data Pointer to flag whether was any packet resent. 
+ */
+void resendPacket(unsigned int offset, void *data) {
+    int *resent = data;
+    TCcSample sample;
+    
+    // Exponential backoff of timeout before first resend, resent packets expire later
+    if (!*resent) {
+        if (++data_timeouts > DATA_RETRIES) {
+            printError(E_DATA);
+        }
+        rttBackoff(&rtt);
+        ccSample(&sample, window.first_seq, 0, 0);
+        ccTimeout(&cc, &sample);
+        *resent = 1;
+    }
+    if (selective) {
+        sendPacket(window.packets[offset]);
+    }
+}
+
+/**
+ * Timer handler - resends packets whose deadline passed and sets timer
+ * to the next deadline. Costs only as much as the number of expired packets.
+ * @param fd Timer descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void resendPackets(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    int resent = 0;
+
+    wheelExpire(&window.timers, ev_now(), resendPacket, &resent);
+    if (resent && !selective) {   // Timers cannot be re-armed during expiration
+        goBack(window.first_seq);
+    }
+    if (syn_deadline && ev_now() >= syn_deadline) {   // SYN is not answered
+        if (!resent && isEmpty(&window)) rttBackoff(&rtt);   // Timeouts of the first flight back off too
+        resent = 1;
+        sendSyn();
     }
+    if (fin_deadline && ev_now() >= fin_deadline) {   // FIN is not answered
+        if (!resent) rttBackoff(&rtt);
+        sendFin();
+    }
+    flushPackets();
+    armTimer(nextDeadline());
+}
 
-    // Sending END packet just 5-times for sure with delay
-    for(int i = 1; i <= 5; i++) {
-        if (!udt_send(udt, dest_addr, dest_port, _packet, packetLen(_packet))) {
-		  printError(E_UDTSEND);
+/**
+ * Splits input into packets and sends them as long as window is not full.
+ * Reading of stdin is watched only whether all input was sent.
+ */
+void sendInput() {
+    char *packet;
+    unsigned short len, flags;
+    
+    while (input_pos < input_cnt && canSend() && paceAllows()) {
+        len = input_lens[input_pos];
+        flags = 0;
+        packet = input[input_pos];
+        if (lz && established) {   // Server could refuse compression - the first flight is not compressed
+            packet = compressData(packet, &len, &flags);
+        }
+		packet = makeDataPacket(packet, len, flags);
+		sendPacket(packet);
+		storePacket(&window, cnt_seq, packet);
+		cnt_seq++;
+        input_pos++;
+        if (fec_block) {
+            protectPacket(packet);
+            if (fec_count == fec_block) {
+                sendParity();
+            }
         }
-        usleep(100); // Sending delay of one packet
     }
+    flushPackets();
+    
+    // Whether window is full, block reading from STDIN - saves CPU
+    ev_modify(&loop, STDIN_FILENO, (input_pos == input_cnt && !input_eof && canSend()) ? EV_READ : 0);
     
-    free(_packet);
+    // EOF - all data are sequenced, FIN follows them at once
+    if (input_eof && input_pos == input_cnt && fin_sends == 0) {
+        if (fec_block) {
+            sendParity();   // The last block is shorter
+        }
+        sendFin();
+    } else if (fin_sends && !fin_deadline && isEmpty(&window)) {
+        finTimer();   // Data are acknowledged, FIN waits for answer alone
+    }
 }
 
+/**
+ * Pacing timer handler - sends next packets.
+ * @param fd Timer descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void pacePackets(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    pace_armed = 0;
+    sendInput();
+}
 
-int main(int argc, char **argv ) {
+/**
+ * Passes waiting partial packet to sending, it follows all read buffers.
+ */
+void flushHold() {
+    if (hold != NULL) {
+        input[input_cnt] = hold;
+        input_lens[input_cnt] = hold_len;
+        input_cnt++;
+        hold = NULL;
+    }
+    if (hold_armed) {
+        ev_timer_arm(nagle_timer, 0);
+        hold_armed = 0;
+    }
+}
+
+/**
+ * Coalescing timer handler - partial packet waited long enough.
+ * @param fd Timer descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void nagleExpired(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    hold_armed = 0;
+    flushHold();
+    sendInput();
+}
+
+/**
+ * Stdin handler - reads next chunk of data straight into packet buffers
+ * behind their headers, so data are never copied. Partial packet waits
+ * for more data while are other packets in flight (Nagle), it is sent
+ * whether is full, window gets idle or nagle_delay expires.
+ * @param fd Stdin descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void readInput(int fd, unsigned int events, void *data) {
+    (void)events; (void)data;
+    struct iovec iov[INPUT_BUFFERS];
+    unsigned int i, held = 0;
+
+    for (i = 0; i < input_max; i++) {
+        if (i == 0 && hold != NULL) {   // Waiting partial packet is filled first
+            input[i] = hold;
+            held = hold_len;
+            hold = NULL;
+        } else if ((input[i] = pool_alloc(&pool)) == NULL) {
+            printError(E_MALLOC);
+        }
+        iov[i].iov_base = &input[i][DATA_OFFSET + (i ? 0 : held)];
+        iov[i].iov_len = data_size - (i ? 0 : held);
+    }
+    ssize_t n = readv(fd, iov, input_max);
+    size_t total = held + (n > 0 ? n : 0);
+    
+    // Filled buffers are sent, the rest returns into pool
+    input_pos = 0;
+    input_cnt = (total + data_size - 1) / data_size;
+    for (i = 0; i < input_max; i++) {
+        if (i < input_cnt) {
+            input_lens[i] = (i + 1) * (size_t)data_size <= total ? data_size : total - i * (size_t)data_size;
+        } else {
+            pool_free(&pool, input[i]);
+        }
+    }
+    if (n == 0) {
+        input_eof = 1;
+    } else if (n < 0 && errno != EAGAIN && errno != EINTR) {
+        printError(E_READ);
+    }
     
-	char input_line[MAXLINE];     /**< input line buffer - filling from stdin */
-	char recv_packet[PACKETSIZE]; /**< recieving packet buffer */
+    // Partial packet waits for more data while are packets in flight
+    if (!nodelay && nagle_delay && !input_eof && input_cnt > 0 &&
+        input_lens[input_cnt - 1] < data_size && !isEmpty(&window)) {
+        hold = input[--input_cnt];
+        hold_len = input_lens[input_cnt];
+        if (!hold_armed) {   // Delay counts from the first waiting byte
+            ev_timer_arm(nagle_timer, nagle_delay * 1000);
+            hold_armed = 1;
+        }
+    } else if (hold_armed) {
+        ev_timer_arm(nagle_timer, 0);
+        hold_armed = 0;
+    }
+    sendInput();
+}
+
+/**
+ * Processes incomming ACK/NACK packet.
+ * @param recv_packet Recieved packet. 
+ * @param n Length of recieved packet. 
+ */
+void processPacket(char *recv_packet, int n) {
 	char *packet;                 /**< packet pointer */
-	int res;                      /**< returned value of select */
-	int setSTDIN;                 /**< is set to 1 whether is needed reading from stdin */
+	RDTPacket view;               /**< decoded header of recieved packet */
+	TCcSample sample;             /**< congestion control event */
+	unsigned int count;           /**< packets inside window before ack */
+	unsigned int high;            /**< sequence behind the highest recieved packet */
+	long rtt_sample = 0;          /**< measured RTT */
 	
-	initWindow(&window);          // Initialize sliding window.
-    // readParams(argc, argv);       // Reads params.
-    
-    setTimer(RETRY);              // Sets retry delay of resending packets.
-	udt = udt_init(src_port);     // Returns socket descriptor.
+    // Check whether has at least header and checksum passes
+	if (parsePacket(recv_packet, n, &view)) {
+        if (view.conn != conn_id) {  // Answer to another connection
+            return;
+        }
+        if (view.flags & RST) {  // SYN refused
+            if (view.flags & FIN) {
+                printError(E_REFUSED);   // Server accepts no connection
+            }
+            if (!established) {
+                restartSyn();
+            }
+            return;
+        }
+        if ((view.flags & SYN) && (view.flags & NACK)) {  // Server does not know connection
+            if (established) {
+                printError(E_RESET);
+            }
+            syn_nacked = 1;
+            return;
+        }
+        if (view.flags & FIN) {  // Server delivered all data - transfer is finished
+            if ((view.flags & ACK) && fin_sends && view.seq == cnt_seq) {   // Stale FIN-ACK confirms no data
+                ev_stop(&loop);
+            }
+            return;
+        }
+        if (view.flags & SYN) {  // Answer to SYN, it acknowledges data as well
+            processSynAck(&view);
+        }
+        count = window.count;
+        if (view.flags & ACK) {  // Cumulative ack recieved
+            // ACK not moving window means that some later packet arrived
+            dup_acks = (view.seq == window.first_seq && !isEmpty(&window)) ? dup_acks + 1 : 0;
+            if (view.seq > 0) {
+                rtt_sample = sampleRtt(view.seq - 1);
+            }
+            removeTo(&window, view.seq);
+        } else if (view.flags & NACK) {  // Nack recieved 
+            if ((packet = getPacket(&window, view.seq)) != NULL) {
+                removeTo(&window, view.seq);
+                if (selective) {
+                    sendPacket(packet);
+                } else {
+                    goBack(view.seq);
+                }
+            }
+        } else {
+            return;
+        }
+        high = view.seq;
+        if (sackCount(recv_packet) > 0) {
+            rtt_sample = processSack(recv_packet, &high);
+        }
+        
+        // Without SACK blocks duplicate ACKs tell only about loss of first unacked packet
+        if (dup_acks >= dup_thresh && high < window.first_seq + dup_thresh + 1) {
+            high = window.first_seq + dup_thresh + 1;
+        }
+        
+        // Packet reported by NACK or resent by fast retransmit was lost
+        ccSample(&sample, view.seq, count - window.count, rtt_sample);
+        if (fastRetransmit(high) || (view.flags & NACK)) {
+            ccLoss(&cc, &sample);
+        }
+        if (sample.acked > 0) {
+            data_timeouts = 0;
+            ccAck(&cc, &sample);
+        }
+    } else {
+        // Bad packet or checksum - try to send first packet from window
+		if (!isEmpty(&window)) {
+            sendPacket(window.packets[window.first_seq & window.mask]);
+        }
+    }
+}
 
-    printf(" In main Fucntion.\n");
+/**
+ * Socket handler - processes all incomming ACK/NACK packets, they are
+ * read by batches. Writable socket continues sending of waiting packets.
+ * @param fd Socket descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void recvPackets(int fd, unsigned int events, void *data) {
+    (void)data;
+	char recv_packets[UDT_BATCH][PACKETSIZE] __attribute__((aligned(PACKET_ALIGN))); /**< recieving packet buffers */
+	udt_datagram dgrams[UDT_BATCH];           /**< recieved datagrams */
+	int n;
+	
+	if (events & EV_WRITE) {
+        flushPackets();   // Socket buffer has space again
+        if (out_count == 0) {   // Only writable socket unblocks - input continues below
+            send_blocked = 0;
+            ev_modify(&loop, fd, EV_READ);
+        }
+    }
+	do {
+        for (int i = 0; i < UDT_BATCH; i++) {
+            dgrams[i].buff = recv_packets[i];
+            dgrams[i].nbytes = PACKETSIZE;
+        }
+        n = udt_recv_batch(fd, dgrams, UDT_BATCH);
+        for (int i = 0; i < n; i++) {
+            processPacket(recv_packets[i], dgrams[i].nbytes);
+        }
+	} while (n == UDT_BATCH);   // Socket could be not drained
+	
+	if (isEmpty(&window)) {
+        armTimer(nextDeadline());   // No packet to resend, SYN or FIN can still wait
+        flushHold();      // Idle window - partial packet does not wait
+    }
+    sendInput();          // Window could slide
+}
+
+/**
+ * Proccesses run params. Returns 0/1 or finishes app in some cases.
+ * @param argc Number of run params. 
+ * @param argv Array with run params.
+ * @return Return 0 on success or 1 on fail.    
+ */
+int readParams(int argc, char **argv) {
+	int ch;
+	while ((ch = getopt(argc,argv,"s:d:w:p:c:r:m:f:zt:ngk")) != -1) {
+		switch(ch) {
+		case 's':  // Source port
+			src_port = atol(optarg);
+			break;
+		case 'd':  // Destination port
+			dest_port = atol(optarg);
+			break;
+		case 'w':  // Window size
+			window_size = atol(optarg);
+			if (window_size == 0 || window_size > WINDOWMAX) {
+				printError(E_WINDOWSIZE);
+			}
+			break;
+		case 'p':  // Data size
+			data_size = atol(optarg);
+			if (data_size == 0 || data_size > MAX_DATASIZE) {
+				printError(E_DATASIZE);
+			}
+			break;
+		case 'c':  // Congestion control
+			cc_name = optarg;
+			break;
+		case 'r':  // Pacing rate
+			pace_rate = strtoul(optarg, NULL, 10);
+			break;
+		case 'm':  // ARQ mode
+			if (strcmp(optarg, "gbn") == 0) {
+				selective = 0;
+			} else if (strcmp(optarg, "sr") == 0) {
+				selective = 1;
+			} else {
+				printError(E_ARQ);
+			}
+			break;
+		case 'f':  // FEC block size
+			fec_block = atol(optarg);
+			if (fec_block == 0 || fec_block > FEC_BLOCKMAX) {
+				printError(E_FEC);
+			}
+			break;
+		case 'z':  // Compression of data
+			lz = 1;
+			break;
+		case 't':  // Max delay of partial packet
+			nagle_delay = atol(optarg);
+			break;
+		case 'n':  // Partial packets are sent at once - latency sensitive data
+			nodelay = 1;
+			break;
+		case 'g':  // Segmentation offload
+			gso = 1;
+			break;
+		case 'k':  // CRC32C instead of checksum, server answers the same way
+			sum_flag = CRC;
+			break;
+		case '?':  // Unknown flag, print error
+			fprintf(stderr, "%s", MSGS[MSG_USAGE]);;
+        }
+	}
+
+	// Missing params or bad params.
+	if (src_port == 0 || dest_port == 0) {
+		printError(E_BADPARAMS);
+	}
+	
+	// Many params
+    if (optind < argc) {
+		fprintf(stderr, "%s", MSGS[MSG_MANYPARAMS]);
+	}
+	return 1;
+}
+
+int main(int argc, char **argv ) {
+    
+    readParams(argc, argv);       // Reads params.
+    checksumInit();               // Selects checksum implementations by CPU
+    if (!selective) {
+        fec_block = 0;            // Go-Back-N drops packets which parity would need
+    }
+    if (fec_block && data_size > FEC_DATASIZE) {
+        data_size = FEC_DATASIZE; // Parity header has to fit into packet
+    }
+	// Sliding window starts small, it grows whether congestion and server allow more packets
+	if (!initWindow(&window, window_size < WINDOWSIZE ? window_size : WINDOWSIZE) ||
+	    !pool_init(&pool, DATA_OFFSET + data_size, window.mask + 1)) {
+		printError(E_MALLOC);
+	}
+	window.pool = &pool;
+	max_data_size = data_size;
+	setDataSize(data_size < MIN_DATASIZE ? data_size : MIN_DATASIZE);  // Until server answers SYN
+    
+    newConnId();
+    initRtt(&rtt, LINKDELAY * 1000); // Initial timeout until RTT is measured.
+    if (!initCongestion(&cc, cc_name, data_size)) {
+        printError(E_CONGESTION);
+    }
+	udt = udt_init_conn(src_port, dest_addr, dest_port); // Socket connected to the server.
+	if (gso && !(gso = udt_gso_supported(udt))) {
+		fprintf(stderr, "%s", MSGS[MSG_NOGSO]);      // Falling back to batches
+	}
 
 	fcntl(STDIN_FILENO, F_SETFL, O_NONBLOCK); // Make stdin reading non-clocking.
 
-    // Setting stdin and udt descriptors to the select awaiting SET
-    printf(" Reading Data Now .\n");
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(udt, &readfds);
-	FD_SET(STDIN_FILENO, &readfds);
+    // Watching stdin, udt, retransmission, pacing and coalescing timers by event loop
+    if (!ev_init(&loop) ||
+        !ev_add(&loop, udt, EV_READ, recvPackets, NULL) ||
+        !ev_add(&loop, STDIN_FILENO, EV_READ, readInput, NULL) ||
+        (rto_timer = ev_timer(&loop, resendPackets, NULL)) == -1 ||
+        (pace_timer = ev_timer(&loop, pacePackets, NULL)) == -1 ||
+        (nagle_timer = ev_timer(&loop, nagleExpired, NULL)) == -1) {
+        printError(E_EVLOOP);
+    }
+    
+    // Data of the first flight follow SYN without waiting for answer
+    sendSyn();
+    
 	// Wait until new data are on stdin or new incomming packet
-    int A_NO = 0;
-    while ((res = select(udt+1, &readfds, NULL, NULL, NULL)) != 0) {
-    if (res == -1) continue; // Select was interupted probablz due to timer
-   
-		if (FD_ISSET(udt, &readfds)) {	// New incomming packet
-            stopTimer();                // Stopping timer - working with shared memory
-			int n = udt_recv(udt, recv_packet, PACKETSIZE, NULL, NULL);
-            // Check whether has at least header and checksum passes
-   			if (n >= DATA_OFFSET && testCheckSum(recv_packet, n)) {
-                if (hasFlags(recv_packet,ACK)) { 
-                    A_NO++;
-                    printf(" Acknowledgment # %d \n",A_NO);         // Ack recieved
-                    removePacket(&window, seqNumber(recv_packet));
-                    // Recieved last ACK packet, exiting
-                    if (feof(stdin) && isEmpty(&window)){
-                        printf(" End of file reached. \n");
-                        break;
-                    } 
-                } else if (hasFlags(recv_packet,NACK)) {  // Nack recieved 
-                    if ((packet = getPacket(&window, seqNumber(recv_packet))) != NULL) {
-                        printf(" Retransmitting packet.. \n");
-                        sendPacket(packet);
-                        removeTo(&window, seqNumber(recv_packet));
-                    }
-                }
-            } else {
-                // Bad packet or checksum - try to send first packet from window
-    			if (!isEmpty(&window)) {
-                    sendPacket(window.packets[window.first_seq % WINDOWSIZE]);
-                }
-            }
-		    startTimer();              // Re-store timer
-		}
-
-        // Reading from STDIN only whether window has available sequences
-	    if ((setSTDIN = isAvailable(&window))) {
-    		if (FD_ISSET(STDIN_FILENO, &readfds)) { // we have read a new line to send
-                if (fgets(input_line, MAXLINE, stdin) != NULL ) {
-                    stopTimer();
-                    printf(" Creating Packet \n");
-        			packet = makeDataPacket(input_line);
-                    printf(" Sending Packet \n");
-        			sendPacket(packet);
-                    printf(" Storing Packet to Window\n");
-        			storePacket(&window, cnt_seq, packet);
-                    printf(" Incrementing Sequence Number\n");
-        			cnt_seq++;
-        			startTimer();
-        		}
-    		} else {
-                // EOF - exiting on empty window
-                if (feof(stdin)) {
-                    setSTDIN = 0;
-                    if (isEmpty(&window)) break;
-                }
-            }
-    	} 
-                     
-		// Settings select fd set
-		FD_ZERO(&readfds);
-		FD_SET(udt, &readfds);
-		// Whether window is full, block reading from STDIN - saves CPU
-		if (setSTDIN) FD_SET(STDIN_FILENO, &readfds);
+	if (!ev_run(&loop)) {
+        printError(E_EVLOOP);
 	}
 	
-	stopTimer();
-	closeConnection();
+	ev_destroy(&loop);
 	destroyWindow(&window);
+	pool_destroy(&pool);
 	return EXIT_SUCCESS;
 }
 /*** End of file rdtclient.c ***/
@@ -0,0 +1,79 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             rtt.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file defining methods of RTT estimator - TRtt struture.
+*
+*******************************************************************/
+/**
+* @file rtt.c
+*
+* @brief Source file defining methods of RTT estimator - TRtt struture.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include <stdlib.h>
+#include "rtt.h"
+
+/**
+ * Initializes RTT estimator.
+ * @param rtt Pointer to estimator.
+ * @param rto Initial retransmission timeout.
+ */
+void initRtt(TRtt *rtt, long rto) {
+    rtt->srtt = 0;
+    rtt->rttvar = 0;
+    rtt->rto = rto;
+    rtt->backoff = 0;
+}
+
+/**
+ * Updates estimator by measured RTT. Caller must not sample
+ * retransmitted packets (Karn's rule).
+ * @param rtt Pointer to estimator.
+ * @param sample Measured RTT.
+ */
+void rttSample(TRtt *rtt, long sample) {
+    if (sample < 0) {  // Change of sys time to the past
+        return;
+    }
+
+    if (rtt->srtt == 0) {  // First measurement
+        rtt->srtt = sample;
+        rtt->rttvar = sample / 2;
+    } else {               // RTTVAR = 3/4 RTTVAR + 1/4 |SRTT - R|, SRTT = 7/8 SRTT + 1/8 R
+        rtt->rttvar += (labs(rtt->srtt - sample) - rtt->rttvar) / 4;
+        rtt->srtt += (sample - rtt->srtt) / 8;
+    }
+
+    rtt->rto = rtt->srtt + 4 * rtt->rttvar;
+    if (rtt->rto < RTO_MIN) rtt->rto = RTO_MIN;
+    if (rtt->rto > RTO_MAX) rtt->rto = RTO_MAX;
+    rtt->backoff = 0;   // Valid sample - path works again
+}
+
+/**
+ * Doubles retransmission timeout after timeout expiration.
+ * @param rtt Pointer to estimator.
+ */
+void rttBackoff(TRtt *rtt) {
+    if ((rtt->rto << rtt->backoff) < RTO_MAX) {
+        rtt->backoff++;
+    }
+}
+
+/**
+ * Returns current retransmission timeout including backoff.
+ * @param rtt Pointer to estimator.
+ * @return Returns retransmission timeout.
+ */
+long rttTimeout(TRtt *rtt) {
+    long rto = rtt->rto << rtt->backoff;
+    return rto < RTO_MAX ? rto : RTO_MAX;
+}
+
+/*** End of file rtt.c ***/
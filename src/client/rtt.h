@@ -0,0 +1,66 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             rtt.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file of RTT estimator - TRtt struture and its methods.
+*
+*******************************************************************/
+/**
+* @file rtt.h
+*
+* @brief Header file of RTT estimator - TRtt struture and its methods.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef RTT_H_
+#define RTT_H_
+
+// Bounds of retransmission timeout in us
+#define RTO_MIN    20000
+#define RTO_MAX    60000000
+
+/**
+ * RTT estimator structure (RFC 6298), all times are in us.
+ */
+typedef struct {
+    long srtt;             /**< smoothed RTT, 0 before first sample */
+    long rttvar;           /**< RTT variation */
+    long rto;              /**< retransmission timeout without backoff */
+    unsigned int backoff;  /**< number of timeouts since last sample */
+} TRtt;
+
+/**
+ * Initializes RTT estimator.
+ * @param rtt Pointer to estimator.
+ * @param rto Initial retransmission timeout.
+ */
+void initRtt(TRtt *rtt, long rto);
+
+/**
+ * Updates estimator by measured RTT. Caller must not sample
+ * retransmitted packets (Karn's rule).
+ * @param rtt Pointer to estimator.
+ * @param sample Measured RTT.
+ */
+void rttSample(TRtt *rtt, long sample);
+
+/**
+ * Doubles retransmission timeout after timeout expiration.
+ * @param rtt Pointer to estimator.
+ */
+void rttBackoff(TRtt *rtt);
+
+/**
+ * Returns current retransmission timeout including backoff.
+ * @param rtt Pointer to estimator.
+ * @return Returns retransmission timeout.
+ */
+long rttTimeout(TRtt *rtt);
+
+#endif /* RTT_H_ */
+
+/*** End of file rtt.h ***/
@@ -21,31 +21,143 @@
 #include <limits.h>
 #include "snd_window.h"
 
+/**
+ * Returns ring capacity for the window size - nearest power of 2.
+ * @param size Window size.
+ * @return Return ring capacity.
+ */
+static unsigned int ringCapacity(unsigned int size) {
+    unsigned int capacity = 1;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
 /**
  * Initializing window.
  * @param window Pointer to window.
+ * @param size Window size, at most WINDOWMAX.
+ * @return Return 1 on success or 0 on memory allocation fail.
  */
-void initWindow(TWindow *window) {
-    for (int i = 0; i < WINDOWSIZE; i++) {
+int initWindow(TWindow *window, unsigned int size) {
+    if (size == 0 || size > WINDOWMAX) {
+        size = WINDOWSIZE;
+    }
+    unsigned int capacity = ringCapacity(size);
+
+    window->packets = malloc(capacity * sizeof(char *));
+    window->timestamps = malloc(capacity * sizeof(time_t));
+    window->sends = calloc(capacity, sizeof(unsigned char));
+    if (window->packets == NULL || window->timestamps == NULL || window->sends == NULL ||
+        !initWheel(&window->timers, capacity, 0)) {
+        free(window->packets);
+        free(window->timestamps);
+        free(window->sends);
+        window->packets = NULL;
+        window->timestamps = NULL;
+        window->sends = NULL;
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < capacity; i++) {
         window->packets[i] = NULL;
         window->timestamps[i] = UINT_MAX;
     }
+    window->size = size;
+    window->mask = capacity - 1;
+    window->pool = NULL;
+    window->count = 0;
     window->first_seq = 0;
     window->last_seq = 0;
+    window->next_seq = 0;
+    return 1;
 }
 
 /**
- * Checks for non-full window.
+ * Releases packet memory - returns buffer into pool or frees it.
  * @param window Pointer to window.
- * @return Return 0 on full window else return 1. 
+ * @param packet Packet to be released.
  */
-int isAvailable(TWindow *window) {
+static void releasePacket(TWindow *window, char *packet) {
+    if (window->pool != NULL) {
+        pool_free(window->pool, packet);
+    } else {
+        free(packet);
+    }
+}
+
+/**
+ * Grows window, stored packets are kept.
+ * @param window Pointer to window.
+ * @param size New window size, at most WINDOWMAX.
+ * @return Return 1 on success or 0 on memory allocation fail or bad size.
+ */
+int growWindow(TWindow *window, unsigned int size) {
+    if (size > WINDOWMAX) {
+        return 0;
+    }
+    if (size <= window->size) {
+        return 1;  // Window never shrinks
+    }
 
-    if (window->first_seq + WINDOWSIZE > window->last_seq + 1) {
+    unsigned int capacity = ringCapacity(size);
+    if (capacity <= window->mask + 1) {  // Enough space inside the ring
+        window->size = size;
         return 1;
     }
 
-    return 0;
+    char **packets = malloc(capacity * sizeof(char *));
+    time_t *timestamps = malloc(capacity * sizeof(time_t));
+    unsigned char *sends = calloc(capacity, sizeof(unsigned char));
+    TWheel timers;
+    int64_t now = window->timers.now * WHEEL_TICK;
+    if (packets == NULL || timestamps == NULL || sends == NULL ||
+        !initWheel(&timers, capacity, now)) {
+        free(packets);
+        free(timestamps);
+        free(sends);
+        return 0;
+    }
+    for (unsigned int i = 0; i < capacity; i++) {
+        packets[i] = NULL;
+        timestamps[i] = UINT_MAX;
+    }
+
+    // Rehash stored sequences into the new ring
+    if (window->count) {
+        for (unsigned int seq = window->first_seq; seq <= window->last_seq; seq++) {
+            packets[seq & (capacity - 1)] = window->packets[seq & window->mask];
+            timestamps[seq & (capacity - 1)] = window->timestamps[seq & window->mask];
+            sends[seq & (capacity - 1)] = window->sends[seq & window->mask];
+            if (wheelArmed(&window->timers, seq & window->mask)) {
+                wheelAdd(&timers, seq & (capacity - 1), now,
+                         wheelDeadline(&window->timers, seq & window->mask));
+            }
+        }
+    }
+
+    free(window->packets);
+    free(window->timestamps);
+    free(window->sends);
+    destroyWheel(&window->timers);
+    window->packets = packets;
+    window->timestamps = timestamps;
+    window->sends = sends;
+    window->timers = timers;
+    window->size = size;
+    window->mask = capacity - 1;
+    return 1;
+}
+
+/**
+ * Checks for non-full window.
+ * @param window Pointer to window.
+ * @return Return 0 on full window else return 1. 
+ */
+int isAvailable(TWindow *window) {
+    // Empty window has last_seq equal to first_seq too, so the next sequence decides
+    return window->next_seq < window->first_seq + window->size;
 }
 
 /**
@@ -54,13 +166,7 @@ int isAvailable(TWindow *window) {
  * @return Return 0 on non-empty window else return 1. 
  */
 int isEmpty(TWindow *window) {
-    if (((window->first_seq == window->last_seq + 1)              // Last is set behind first awaiting
-        || ((window->first_seq == 0) && (window->last_seq == 0))) // Just initialized and waiting for 0 seq
-        && (window->packets[window->first_seq % WINDOWSIZE] == NULL)) {
-        return 1;
-    }
-
-    return 0;
+    return window->count == 0;
 }
 
 /**
@@ -72,8 +178,8 @@ int isEmpty(TWindow *window) {
 char *getPacket(TWindow *window, unsigned int seq_num) {
     // Check for range
     if ((window->first_seq <= seq_num) &&
-        (seq_num < window->first_seq + WINDOWSIZE)) {
-        return window->packets[seq_num % WINDOWSIZE];
+        (seq_num < window->first_seq + window->size)) {
+        return window->packets[seq_num & window->mask];
     }
 
     return NULL;
@@ -89,30 +195,35 @@ char *getPacket(TWindow *window, unsigned int seq_num) {
 char *storePacket(TWindow *window, unsigned int seq_num, char *packet) {
     // Check for ranges and empty place
     if ((window->first_seq <= seq_num) &&
-        (seq_num < window->first_seq + WINDOWSIZE) &&
-        (window->packets[seq_num % WINDOWSIZE] == NULL)) {
+        (seq_num < window->first_seq + window->size) &&
+        (window->packets[seq_num & window->mask] == NULL)) {
         
         // Setting new last sequence
         if (window->last_seq < seq_num) {
             window->last_seq = seq_num;
         }
+        if (window->next_seq <= seq_num) {
+            window->next_seq = seq_num + 1;
+        }
         
         // Success, returning same packet from window
-        return window->packets[seq_num % WINDOWSIZE] = packet;
+        window->count++;
+        return window->packets[seq_num & window->mask] = packet;
     }
 
     return NULL;   // Fail
 }
 
 /**
- * Slides window.
+ * Slides window. Every sequence is passed only once, so sliding
+ * costs amortized O(1) per removed packet.
  * @param window Pointer to window.
  */
 void slideWindow(TWindow *window) {
     // Slide from begin to end
     while (window->first_seq <= window->last_seq) {
         // Slide until first not null packet is reached
-        if (window->packets[(window->first_seq) % WINDOWSIZE] == NULL) {
+        if (window->packets[window->first_seq & window->mask] == NULL) {
             window->first_seq++;
         } else {
             break;
@@ -127,17 +238,20 @@ void slideWindow(TWindow *window) {
  * @return Return 1 on success else 0. 
  */
 int removePacket(TWindow *window, unsigned int seq_num) {
-    unsigned int offset = seq_num % WINDOWSIZE;
+    unsigned int offset = seq_num & window->mask;
 
     // Check for ranges
     if ((window->first_seq <= seq_num) &&
-        (seq_num < window->first_seq + WINDOWSIZE) &&
+        (seq_num < window->first_seq + window->size) &&
         (window->packets[offset] != NULL)) {
 
         // Initializig to default
-        free(window->packets[offset]);
+        releasePacket(window, window->packets[offset]);
         window->packets[offset] = NULL;
         window->timestamps[offset] = UINT_MAX;
+        window->sends[offset] = 0;
+        wheelRemove(&window->timers, offset);      // Acknowledged, nothing to resend
+        window->count--;
         slideWindow(window);                       // Try to slide window
         return 1;
     }
@@ -151,22 +265,49 @@ int removePacket(TWindow *window, unsigned int seq_num) {
  * @param seq_num Sequence number of packet. 
  */
 void removeTo(TWindow *window, unsigned int seq_num) {
-    while (window->first_seq < seq_num) {
+    while (window->first_seq < seq_num && !isEmpty(window)) {
         removePacket(window, window->first_seq);
     }
 }
 
+/**
+ * Removes packets of the specified range from window.
+ * @param window Pointer to window.
+ * @param start First sequence number of range. 
+ * @param end Sequence number behind the range. 
+ */
+void removeRange(TWindow *window, unsigned int start, unsigned int end) {
+    // Only sequences inside window can be removed
+    if (start < window->first_seq) {
+        start = window->first_seq;
+    }
+    if (end > window->last_seq + 1) {
+        end = window->last_seq + 1;
+    }
+    for (unsigned int seq = start; seq < end; seq++) {
+        if (window->packets[seq & window->mask] != NULL) {
+            removePacket(window, seq);
+        }
+    }
+}
+
 /**
  * Destroyes window.
  * @param window Pointer to window.
  */
 void destroyWindow(TWindow *window) {
-    for (int i = 0; i < WINDOWSIZE; i++) {
-        if (window->packets[i] != NULL) {
-            free(window->packets[i]);
-            window->packets[i] = NULL;
-            window->timestamps[i] = UINT_MAX;
+    if (window->packets != NULL) {
+        for (unsigned int i = 0; i <= window->mask; i++) {
+            releasePacket(window, window->packets[i]);
         }
     }
+    free(window->packets);
+    free(window->timestamps);
+    free(window->sends);
+    destroyWheel(&window->timers);
+    window->packets = NULL;
+    window->timestamps = NULL;
+    window->sends = NULL;
+    window->count = 0;
 }
 /*** End of file snd_window.c ***/
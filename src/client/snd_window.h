@@ -17,25 +17,46 @@
 */
 
 #include <time.h>
+#include "timer_wheel.h"
+#include "../libs/pool.h"
 
-// Window size
-#define WINDOWSIZE 5
+// Default window size
+#define WINDOWSIZE 64
+// Max window size the ring can grow to
+#define WINDOWMAX  65536
 
 /**
- * Window structure.
+ * Window structure - ring of packets indexed by sequence number.
  */
 typedef struct {
-    char *packets[WINDOWSIZE];           /**< array with packets */
-    time_t timestamps[WINDOWSIZE];       /**< sending timestamps for each packet */
+    char **packets;                      /**< ring with packets */
+    time_t *timestamps;                  /**< sending timestamps for each packet in us */
+    unsigned char *sends;                /**< number of transmissions of each packet */
+    TWheel timers;                       /**< retransmission timers indexed by ring offset */
+    TPool *pool;                         /**< pool of packet buffers, NULL whether are packets malloced */
+    unsigned int size;                   /**< usable window size */
+    unsigned int mask;                   /**< ring capacity - 1, capacity is power of 2 */
+    unsigned int count;                  /**< number of stored packets */
     unsigned int first_seq;              /**< first set sequence */
     unsigned int last_seq;               /**< last set sequence */
+    unsigned int next_seq;               /**< sequence behind the last stored packet, next one to store */
 } TWindow;
 
 /**
  * Initializing window.
  * @param window Pointer to window.
+ * @param size Window size, at most WINDOWMAX.
+ * @return Return 1 on success or 0 on memory allocation fail.
  */
-void initWindow(TWindow *window);
+int initWindow(TWindow *window, unsigned int size);
+
+/**
+ * Grows window, stored packets are kept.
+ * @param window Pointer to window.
+ * @param size New window size, at most WINDOWMAX.
+ * @return Return 1 on success or 0 on memory allocation fail or bad size.
+ */
+int growWindow(TWindow *window, unsigned int size);
 
 /**
  * Gets packet from window.
@@ -89,4 +110,12 @@ int isEmpty(TWindow *window);
  */
 void removeTo(TWindow *window, unsigned int seq_num);
 
+/**
+ * Removes packets of the specified range from window.
+ * @param window Pointer to window.
+ * @param start First sequence number of range. 
+ * @param end Sequence number behind the range. 
+ */
+void removeRange(TWindow *window, unsigned int start, unsigned int end);
+
 /*** End of file snd_window.h ***/
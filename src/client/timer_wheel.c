@@ -0,0 +1,292 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             timer_wheel.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file defining methods of hierarchical timer wheel
+*        - TWheel struture.
+*
+*******************************************************************/
+/**
+* @file timer_wheel.c
+*
+* @brief Source file defining methods of hierarchical timer wheel
+* @brief - TWheel struture.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include <stdlib.h>
+#include "timer_wheel.h"
+
+#define WHEEL_MASK    (WHEEL_SLOTS - 1)
+#define WHEEL_RANGE   (1LL << (WHEEL_BITS * WHEEL_LEVELS))    // Range of wheel in ticks
+
+/**
+ * Rotates bitmap of slots, so slot of the specified tick is the lowest bit.
+ * @param bitmap Bitmap of slots.
+ * @param tick Tick.
+ * @return Returns rotated bitmap.
+ */
+static inline uint64_t wheelRotate(uint64_t bitmap, int64_t tick) {
+    int shift = tick & WHEEL_MASK;
+    return shift ? (bitmap >> shift) | (bitmap << (WHEEL_SLOTS - shift)) : bitmap;
+}
+
+/**
+ * Initializes timer wheel with disarmed timers.
+ * @param wheel Pointer to wheel.
+ * @param count Number of timers.
+ * @param now Current time in us.
+ * @return Return 1 on success or 0 on memory allocation fail.
+ */
+int initWheel(TWheel *wheel, unsigned int count, int64_t now) {
+    wheel->timers = malloc(count * sizeof(TWheelTimer));
+    if (wheel->timers == NULL) {
+        return 0;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        wheel->timers[i].slot = -1;
+    }
+    for (int i = 0; i < WHEEL_LEVELS * WHEEL_SLOTS; i++) {
+        wheel->heads[i] = -1;
+    }
+    for (int i = 0; i < WHEEL_LEVELS; i++) {
+        wheel->occupied[i] = 0;
+    }
+    wheel->count = count;
+    wheel->armed = 0;
+    wheel->now = now / WHEEL_TICK;
+    return 1;
+}
+
+/**
+ * Links timer into slot list according to its expiration.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ */
+static void wheelLink(TWheel *wheel, unsigned int id) {
+    TWheelTimer *timer = &wheel->timers[id];
+    int64_t base = wheel->now + 1;            // First unprocessed tick
+    int level = 0;
+
+    if (timer->expires < base) {              // Already expired - fire on next tick
+        timer->expires = base;
+    } else if (timer->expires - base >= WHEEL_RANGE) {  // Out of range - fire on range end
+        timer->expires = base + WHEEL_RANGE - 1;
+    }
+    while (level < WHEEL_LEVELS - 1 &&
+           timer->expires - base >= (1LL << (WHEEL_BITS * (level + 1)))) {
+        level++;
+    }
+
+    int slot = (timer->expires >> (WHEEL_BITS * level)) & WHEEL_MASK;
+    timer->slot = level * WHEEL_SLOTS + slot;
+    timer->prev = -1;
+    timer->next = wheel->heads[timer->slot];
+    if (timer->next != -1) {
+        wheel->timers[timer->next].prev = id;
+    }
+    wheel->heads[timer->slot] = id;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+/**
+ * Unlinks timer from its slot list.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ */
+static void wheelUnlink(TWheel *wheel, unsigned int id) {
+    TWheelTimer *timer = &wheel->timers[id];
+
+    if (timer->prev != -1) {
+        wheel->timers[timer->prev].next = timer->next;
+    } else {
+        wheel->heads[timer->slot] = timer->next;
+        if (timer->next == -1) {   // Slot is empty now
+            wheel->occupied[timer->slot / WHEEL_SLOTS] &= ~(1ULL << (timer->slot & WHEEL_MASK));
+        }
+    }
+    if (timer->next != -1) {
+        wheel->timers[timer->next].prev = timer->prev;
+    }
+    timer->slot = -1;
+}
+
+/**
+ * Arms or re-arms timer, costs O(1).
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @param now Current time in us - idle wheel is moved to it.
+ * @param deadline Time of expiration in us.
+ */
+void wheelAdd(TWheel *wheel, unsigned int id, int64_t now, int64_t deadline) {
+    if (wheel->timers[id].slot != -1) {
+        wheelUnlink(wheel, id);
+    } else {
+        if (wheel->armed == 0 && now / WHEEL_TICK > wheel->now) {
+            wheel->now = now / WHEEL_TICK;   // Nothing to cascade, skip idle time
+        }
+        wheel->armed++;
+    }
+    // Round up - timer never expires before deadline
+    wheel->timers[id].expires = (deadline + WHEEL_TICK - 1) / WHEEL_TICK;
+    wheelLink(wheel, id);
+}
+
+/**
+ * Disarms timer, costs O(1).
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ */
+void wheelRemove(TWheel *wheel, unsigned int id) {
+    if (wheel->timers[id].slot != -1) {
+        wheelUnlink(wheel, id);
+        wheel->armed--;
+    }
+}
+
+/**
+ * Checks whether is timer armed.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @return Return 1 whether is timer armed else returns 0.
+ */
+int wheelArmed(TWheel *wheel, unsigned int id) {
+    return wheel->timers[id].slot != -1;
+}
+
+/**
+ * Returns expiration time of armed timer.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @return Return time of expiration in us.
+ */
+int64_t wheelDeadline(TWheel *wheel, unsigned int id) {
+    return wheel->timers[id].expires * WHEEL_TICK;
+}
+
+/**
+ * Moves timers of higher level slot into lower levels.
+ * @param wheel Pointer to wheel.
+ * @param level Level of slot.
+ * @param slot Index of slot inside level.
+ */
+static void wheelCascade(TWheel *wheel, int level, int slot) {
+    int id = wheel->heads[level * WHEEL_SLOTS + slot];
+
+    wheel->heads[level * WHEEL_SLOTS + slot] = -1;
+    wheel->occupied[level] &= ~(1ULL << slot);
+    while (id != -1) {
+        int next = wheel->timers[id].next;
+        wheelLink(wheel, id);
+        id = next;
+    }
+}
+
+/**
+ * Moves wheel to the current time and calls handler for each expired timer.
+ * Expired timers are disarmed before handler is called, so it can re-arm them.
+ * @param wheel Pointer to wheel.
+ * @param now Current time in us.
+ * @param handler Expiration handler.
+ * @param data User data for handler.
+ * @return Returns number of expired timers.
+ */
+unsigned int wheelExpire(TWheel *wheel, int64_t now, wheel_handler handler, void *data) {
+    int64_t target = now / WHEEL_TICK;
+    unsigned int expired = 0;
+
+    while (wheel->now < target) {
+        int64_t tick = wheel->now + 1;
+
+        if (wheel->armed == 0) {   // Nothing to do
+            wheel->now = target;
+            break;
+        }
+
+        // Skip ticks without expiration up to the next cascade
+        if (tick & WHEEL_MASK) {
+            int64_t next = ((tick >> WHEEL_BITS) + 1) << WHEEL_BITS;
+            uint64_t rotated = wheelRotate(wheel->occupied[0], tick);
+            if (rotated && tick + __builtin_ctzll(rotated) < next) {
+                next = tick + __builtin_ctzll(rotated);
+            }
+            if (next > target) {
+                wheel->now = target;
+                break;
+            }
+            if (next != tick) {
+                wheel->now = next - 1;
+                continue;
+            }
+        } else {
+            // Cascade higher levels whose slot time has come
+            for (int level = 1; level < WHEEL_LEVELS; level++) {
+                int slot = (tick >> (WHEEL_BITS * level)) & WHEEL_MASK;
+                wheelCascade(wheel, level, slot);
+                if (slot != 0) break;
+            }
+        }
+
+        // Expire level 0 slot, list is detached - handler can re-arm timers
+        int slot = tick & WHEEL_MASK;
+        int id = wheel->heads[slot];
+        wheel->heads[slot] = -1;
+        wheel->occupied[0] &= ~(1ULL << slot);
+        wheel->now = tick;
+        while (id != -1) {
+            int next = wheel->timers[id].next;
+            wheel->timers[id].slot = -1;
+            wheel->armed--;
+            expired++;
+            handler(id, data);
+            id = next;
+        }
+    }
+    return expired;
+}
+
+/**
+ * Returns time when wheel should be moved next - the earliest expiration
+ * or cascade of higher level.
+ * @param wheel Pointer to wheel.
+ * @return Returns time in us or 0 whether is no timer armed.
+ */
+int64_t wheelNext(TWheel *wheel) {
+    if (wheel->armed == 0) {
+        return 0;
+    }
+
+    int64_t tick = wheel->now + 1;
+    int64_t next = INT64_MAX;
+
+    if (wheel->occupied[0]) {
+        next = tick + __builtin_ctzll(wheelRotate(wheel->occupied[0], tick));
+    }
+    for (int level = 1; level < WHEEL_LEVELS; level++) {
+        if (wheel->occupied[level]) {   // Higher level timers need cascade on next boundary
+            int64_t cascade = (tick & WHEEL_MASK) ? ((tick >> WHEEL_BITS) + 1) << WHEEL_BITS : tick;
+            if (cascade < next) {
+                next = cascade;
+            }
+            break;
+        }
+    }
+    return next * WHEEL_TICK;
+}
+
+/**
+ * Destroyes timer wheel.
+ * @param wheel Pointer to wheel.
+ */
+void destroyWheel(TWheel *wheel) {
+    free(wheel->timers);
+    wheel->timers = NULL;
+    wheel->count = 0;
+    wheel->armed = 0;
+}
+
+/*** End of file timer_wheel.c ***/
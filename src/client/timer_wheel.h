@@ -0,0 +1,130 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             timer_wheel.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file of hierarchical timer wheel - TWheel struture
+*        and its methods.
+*
+*******************************************************************/
+/**
+* @file timer_wheel.h
+*
+* @brief Header file of hierarchical timer wheel - TWheel struture
+* @brief and its methods.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef TIMER_WHEEL_H_
+#define TIMER_WHEEL_H_
+
+#include <stdint.h>
+
+#define WHEEL_BITS    6                    // Slots of one level as power of 2
+#define WHEEL_SLOTS   (1 << WHEEL_BITS)    // Slots of one level
+#define WHEEL_LEVELS  4                    // Number of levels - 64^4 ticks range
+#define WHEEL_TICK    1000                 // Length of tick in us
+
+/**
+ * Timer structure, timers are identified by index.
+ */
+typedef struct {
+    int64_t expires;       /**< expiration tick */
+    int next;              /**< next timer inside slot, -1 on end */
+    int prev;              /**< previous timer inside slot, -1 on begin */
+    int slot;              /**< index of slot list, -1 whether timer is not armed */
+} TWheelTimer;
+
+/**
+ * Timer wheel structure. Level 0 holds timers expiring during next
+ * WHEEL_SLOTS ticks, each higher level has WHEEL_SLOTS times longer slots
+ * and its timers are cascaded to lower levels when their time comes.
+ */
+typedef struct {
+    TWheelTimer *timers;                          /**< array of timers */
+    unsigned int count;                           /**< number of timers */
+    unsigned int armed;                           /**< number of armed timers */
+    int heads[WHEEL_LEVELS * WHEEL_SLOTS];        /**< first timer of each slot */
+    uint64_t occupied[WHEEL_LEVELS];              /**< bitmap of non-empty slots */
+    int64_t now;                                  /**< last processed tick */
+} TWheel;
+
+/**
+ * Expiration handler.
+ * @param id Index of expired timer.
+ * @param data User data.
+ */
+typedef void (*wheel_handler)(unsigned int id, void *data);
+
+/**
+ * Initializes timer wheel with disarmed timers.
+ * @param wheel Pointer to wheel.
+ * @param count Number of timers.
+ * @param now Current time in us.
+ * @return Return 1 on success or 0 on memory allocation fail.
+ */
+int initWheel(TWheel *wheel, unsigned int count, int64_t now);
+
+/**
+ * Arms or re-arms timer, costs O(1).
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @param now Current time in us - idle wheel is moved to it.
+ * @param deadline Time of expiration in us.
+ */
+void wheelAdd(TWheel *wheel, unsigned int id, int64_t now, int64_t deadline);
+
+/**
+ * Disarms timer, costs O(1).
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ */
+void wheelRemove(TWheel *wheel, unsigned int id);
+
+/**
+ * Checks whether is timer armed.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @return Return 1 whether is timer armed else returns 0.
+ */
+int wheelArmed(TWheel *wheel, unsigned int id);
+
+/**
+ * Returns expiration time of armed timer.
+ * @param wheel Pointer to wheel.
+ * @param id Index of timer.
+ * @return Return time of expiration in us.
+ */
+int64_t wheelDeadline(TWheel *wheel, unsigned int id);
+
+/**
+ * Moves wheel to the current time and calls handler for each expired timer.
+ * Expired timers are disarmed before handler is called, so it can re-arm them.
+ * @param wheel Pointer to wheel.
+ * @param now Current time in us.
+ * @param handler Expiration handler.
+ * @param data User data for handler.
+ * @return Returns number of expired timers.
+ */
+unsigned int wheelExpire(TWheel *wheel, int64_t now, wheel_handler handler, void *data);
+
+/**
+ * Returns time when wheel should be moved next - the earliest expiration
+ * or cascade of higher level.
+ * @param wheel Pointer to wheel.
+ * @return Returns time in us or 0 whether is no timer armed.
+ */
+int64_t wheelNext(TWheel *wheel);
+
+/**
+ * Destroyes timer wheel.
+ * @param wheel Pointer to wheel.
+ */
+void destroyWheel(TWheel *wheel);
+
+#endif /* TIMER_WHEEL_H_ */
+
+/*** End of file timer_wheel.h ***/
@@ -0,0 +1,277 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             evloop.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file with inline methods of single-threaded event loop
+*        built on epoll. Timers are timerfd descriptors inside the loop.
+*
+*******************************************************************/
+/**
+* @file evloop.h
+*
+* @brief Header file with inline methods of single-threaded event loop
+* @brief built on epoll. Timers are timerfd descriptors inside the loop.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef EVLOOP_H_
+#define EVLOOP_H_
+
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
+#define EV_MAXEVENTS  16          // Max number of descriptors inside loop
+
+/**
+ * Enum of watched events.
+ */
+enum evtypes {
+    EV_READ      = EPOLLIN,  /**< enum descriptor is readable / timer expired */
+    EV_WRITE     = EPOLLOUT  /**< enum descriptor is writable */
+};
+
+/**
+ * Event handler.
+ * @param fd Descriptor with event.
+ * @param events Occured events.
+ * @param data User data registered with descriptor.
+ */
+typedef void (*ev_handler)(int fd, unsigned int events, void *data);
+
+/**
+ * Watched descriptor structure.
+ */
+typedef struct {
+    int fd;                   /**< descriptor, -1 whether is item free */
+    unsigned int events;      /**< watched events, 0 pauses watching */
+    int polled;               /**< 0 whether descriptor cannot be epolled - regular file, always ready */
+    int timer;                /**< 1 whether descriptor is timerfd */
+    ev_handler handler;       /**< event handler */
+    void *data;               /**< user data for handler */
+} TEvent;
+
+/**
+ * Event loop structure.
+ */
+typedef struct {
+    int epfd;                         /**< epoll descriptor */
+    int running;                      /**< 0 whether loop should stop */
+    TEvent events[EV_MAXEVENTS];      /**< watched descriptors */
+} TEvLoop;
+
+/**
+ * Returns current time of monotonic clock in us.
+ * @return Current time in us.
+ */
+static inline int64_t ev_now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+/**
+ * Initializes event loop.
+ * @param loop Pointer to loop.
+ * @return Returns 1 on success or 0 on fail.
+ */
+static inline int ev_init(TEvLoop *loop) {
+    for (int i = 0; i < EV_MAXEVENTS; i++) {
+        loop->events[i].fd = -1;
+    }
+    loop->running = 0;
+    loop->epfd = epoll_create1(0);
+    return loop->epfd != -1;
+}
+
+/**
+ * Finds watched descriptor inside loop.
+ * @param loop Pointer to loop.
+ * @param fd Descriptor.
+ * @return Returns pointer to watched descriptor or NULL.
+ */
+static inline TEvent *ev_find(TEvLoop *loop, int fd) {
+    for (int i = 0; i < EV_MAXEVENTS; i++) {
+        if (loop->events[i].fd == fd) {
+            return &loop->events[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Adds descriptor into loop. Descriptors which cannot be epolled
+ * (regular files) are considered as always ready.
+ * @param loop Pointer to loop.
+ * @param fd Descriptor.
+ * @param events Watched events.
+ * @param handler Event handler.
+ * @param data User data for handler.
+ * @return Returns 1 on success or 0 on fail.
+ */
+static inline int ev_add(TEvLoop *loop, int fd, unsigned int events, ev_handler handler, void *data) {
+    TEvent *ev = ev_find(loop, -1);
+    if (ev == NULL) {
+        errno = ENOSPC;
+        return 0;
+    }
+
+    struct epoll_event epev;
+    epev.events = events;
+    epev.data.ptr = ev;
+    ev->polled = 1;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &epev) == -1) {
+        if (errno != EPERM) return 0;
+        ev->polled = 0;
+    }
+
+    ev->fd = fd;
+    ev->events = events;
+    ev->timer = 0;
+    ev->handler = handler;
+    ev->data = data;
+    return 1;
+}
+
+/**
+ * Changes watched events of descriptor.
+ * @param loop Pointer to loop.
+ * @param fd Descriptor.
+ * @param events Watched events, 0 pauses watching.
+ * @return Returns 1 on success or 0 on fail.
+ */
+static inline int ev_modify(TEvLoop *loop, int fd, unsigned int events) {
+    TEvent *ev = ev_find(loop, fd);
+    if (ev == NULL) return 0;
+    if (ev->events == events) return 1;   // Saves syscall
+
+    int op = EPOLL_CTL_MOD;
+    if (events == 0) {            // Paused descriptor is removed, so hang-up is not reported
+        op = EPOLL_CTL_DEL;
+    } else if (ev->events == 0) {
+        op = EPOLL_CTL_ADD;
+    }
+    ev->events = events;
+    if (ev->polled) {
+        struct epoll_event epev;
+        epev.events = events;
+        epev.data.ptr = ev;
+        return epoll_ctl(loop->epfd, op, fd, &epev) != -1;
+    }
+    return 1;
+}
+
+/**
+ * Creates timer inside loop, timer is disarmed.
+ * @param loop Pointer to loop.
+ * @param handler Handler called on expiration.
+ * @param data User data for handler.
+ * @return Returns timer descriptor or -1 on fail.
+ */
+static inline int ev_timer(TEvLoop *loop, ev_handler handler, void *data) {
+    int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) return -1;
+    if (!ev_add(loop, fd, EV_READ, handler, data)) {
+        close(fd);
+        return -1;
+    }
+    ev_find(loop, fd)->timer = 1;
+    return fd;
+}
+
+/**
+ * Arms one-shot timer.
+ * @param fd Timer descriptor.
+ * @param delay Delay in us, 0 disarms timer.
+ * @return Returns 1 on success or 0 on fail.
+ */
+static inline int ev_timer_arm(int fd, int64_t delay) {
+    struct itimerspec spec;
+    spec.it_interval.tv_sec = 0;
+    spec.it_interval.tv_nsec = 0;
+    if (delay < 0) delay = 1;   // Expired already, zero value would disarm timer
+    spec.it_value.tv_sec = delay / 1000000;
+    spec.it_value.tv_nsec = (delay % 1000000) * 1000;
+    return timerfd_settime(fd, 0, &spec, NULL) != -1;
+}
+
+/**
+ * Runs loop until ev_stop is called.
+ * @param loop Pointer to loop.
+ * @return Returns 1 on success or 0 on fail of epoll.
+ */
+static inline int ev_run(TEvLoop *loop) {
+    struct epoll_event epevs[EV_MAXEVENTS];
+
+    loop->running = 1;
+    while (loop->running) {
+        // Do not sleep whether is any always ready descriptor watched
+        int timeout = -1;
+        for (int i = 0; i < EV_MAXEVENTS; i++) {
+            if (loop->events[i].fd != -1 && !loop->events[i].polled && loop->events[i].events) {
+                timeout = 0;
+                break;
+            }
+        }
+
+        int n = epoll_wait(loop->epfd, epevs, EV_MAXEVENTS, timeout);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+
+        for (int i = 0; i < n && loop->running; i++) {
+            TEvent *ev = epevs[i].data.ptr;
+            if (ev->fd == -1 || !ev->events) continue;   // Paused by previous handler
+            if (ev->timer) {   // Consume expiration, loop is level-triggered
+                uint64_t expirations;
+                if (read(ev->fd, &expirations, sizeof(expirations)) != sizeof(expirations)) continue;
+            }
+            ev->handler(ev->fd, epevs[i].events, ev->data);
+        }
+
+        for (int i = 0; i < EV_MAXEVENTS && loop->running; i++) {
+            TEvent *ev = &loop->events[i];
+            if (ev->fd != -1 && !ev->polled && ev->events) {
+                ev->handler(ev->fd, ev->events, ev->data);
+            }
+        }
+    }
+    return 1;
+}
+
+/**
+ * Stops loop, can be called from handler.
+ * @param loop Pointer to loop.
+ */
+static inline void ev_stop(TEvLoop *loop) {
+    loop->running = 0;
+}
+
+/**
+ * Destroyes loop, closes timers.
+ * @param loop Pointer to loop.
+ */
+static inline void ev_destroy(TEvLoop *loop) {
+    for (int i = 0; i < EV_MAXEVENTS; i++) {
+        if (loop->events[i].fd != -1 && loop->events[i].timer) {
+            close(loop->events[i].fd);
+        }
+        loop->events[i].fd = -1;
+    }
+    if (loop->epfd != -1) {
+        close(loop->epfd);
+        loop->epfd = -1;
+    }
+}
+
+#endif /* EVLOOP_H_ */
+
+/*** End of file evloop.h ***/
@@ -0,0 +1,216 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             lz.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file with inline methods of fast LZ77 codec. Each block
+*        is coded alone, so it can be decoded without other blocks.
+*
+*******************************************************************/
+/**
+* @file lz.h
+*
+* @brief Header file with inline methods of fast LZ77 codec. Each block
+* @brief is coded alone, so it can be decoded without other blocks.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef LZ_H_
+#define LZ_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define LZ_MINMATCH   4           // Shortest coded match
+#define LZ_HASH_BITS  12          // Size of match table as power of 2
+#define LZ_MAXBLOCK   65535       // Max length of block - offsets have 16 bits
+
+/*
+ * Block is coded as sequences. Each sequence is token (high nibble - number
+ * of literals, low nibble - match length - LZ_MINMATCH), extension bytes of
+ * literal count whether nibble is 15, literals, 2-byte little-endian offset
+ * and extension bytes of match length. The last sequence has only literals.
+ */
+
+/**
+ * Codes length which does not fit into token nibble.
+ * @param op Output position.
+ * @param len Length.
+ * @return Returns output position behind coded bytes.
+ */
+static inline unsigned char *lz_length(unsigned char *op, unsigned int len) {
+    if (len >= 15) {
+        for (len -= 15; len >= 255; len -= 255) {
+            *op++ = 255;
+        }
+        *op++ = len;
+    }
+    return op;
+}
+
+/**
+ * Codes one sequence - literals followed by match.
+ * @param out Pointer to output position, it is moved behind sequence.
+ * @param oend End of output.
+ * @param lit Literals.
+ * @param lit_len Number of literals.
+ * @param offset Distance of match, unused whether is match_len 0.
+ * @param match_len Length of match or 0 for the last sequence.
+ * @return Returns 1 on success or 0 whether does not output fit.
+ */
+static inline int lz_sequence(unsigned char **out, unsigned char *oend, const unsigned char *lit,
+                              unsigned int lit_len, unsigned int offset, unsigned int match_len) {
+    unsigned char *op = *out;
+    unsigned int ml = match_len ? match_len - LZ_MINMATCH : 0;
+
+    // Worst case of sequence size
+    if ((size_t)(oend - op) < 1 + lit_len / 255 + 1 + lit_len + 2 + ml / 255 + 1) {
+        return 0;
+    }
+    *op++ = (lit_len < 15 ? lit_len : 15) << 4 | (ml < 15 ? ml : 15);
+    op = lz_length(op, lit_len);
+    memcpy(op, lit, lit_len);
+    op += lit_len;
+    if (match_len) {
+        *op++ = offset & 0xFF;
+        *op++ = offset >> 8;
+        op = lz_length(op, ml);
+    }
+    *out = op;
+    return 1;
+}
+
+/**
+ * Compresses block, matches are found by hash table of the last positions.
+ * @param src Data to compress.
+ * @param len Length of data, at most LZ_MAXBLOCK.
+ * @param dst Output buffer.
+ * @param max Size of output buffer.
+ * @return Returns length of compressed data or 0 whether does not output fit.
+ */
+static inline unsigned int lz_compress(const char *src, unsigned int len, char *dst, unsigned int max) {
+    uint16_t table[1 << LZ_HASH_BITS];
+    const unsigned char *in = (const unsigned char *)src;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned int ip = 0, anchor = 0;
+    uint32_t seq, ref_seq;
+
+    if (len > LZ_MAXBLOCK) {
+        return 0;
+    }
+    memset(table, 0, sizeof(table));
+    while (ip + LZ_MINMATCH <= len) {
+        memcpy(&seq, &in[ip], sizeof(seq));
+        unsigned int hash = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        unsigned int ref = table[hash];
+        table[hash] = ip;
+        memcpy(&ref_seq, &in[ref], sizeof(ref_seq));
+        if (ref >= ip || ref_seq != seq) {
+            ip++;
+            continue;
+        }
+
+        unsigned int match_len = LZ_MINMATCH;
+        while (ip + match_len < len && in[ref + match_len] == in[ip + match_len]) {
+            match_len++;
+        }
+        if (!lz_sequence(&op, (unsigned char *)dst + max, &in[anchor], ip - anchor, ip - ref, match_len)) {
+            return 0;
+        }
+        ip += match_len;
+        anchor = ip;
+
+        // Position inside match helps to find the next one
+        if (ip - 2 + LZ_MINMATCH <= len) {
+            memcpy(&seq, &in[ip - 2], sizeof(seq));
+            table[(seq * 2654435761u) >> (32 - LZ_HASH_BITS)] = ip - 2;
+        }
+    }
+    if (anchor < len &&
+        !lz_sequence(&op, (unsigned char *)dst + max, &in[anchor], len - anchor, 0, 0)) {
+        return 0;
+    }
+    return op - (unsigned char *)dst;
+}
+
+/**
+ * Reads length extension bytes.
+ * @param ip Pointer to input position, it is moved behind extension.
+ * @param iend End of input.
+ * @param len Pointer to length, extension is added.
+ * @return Returns 1 on success or 0 whether is input truncated.
+ */
+static inline int lz_read_length(const unsigned char **ip, const unsigned char *iend, unsigned int *len) {
+    unsigned int byte;
+    do {
+        if (*ip >= iend) {
+            return 0;
+        }
+        byte = *(*ip)++;
+        *len += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+/**
+ * Decompresses block, malformed data never cause access outside buffers.
+ * @param src Compressed data.
+ * @param len Length of compressed data.
+ * @param dst Output buffer.
+ * @param max Size of output buffer.
+ * @return Returns length of decompressed data or -1 whether are data malformed.
+ */
+static inline int lz_decompress(const char *src, unsigned int len, char *dst, unsigned int max) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *iend = ip + len;
+    unsigned char *op = (unsigned char *)dst;
+    unsigned char *oend = op + max;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        unsigned int lit_len = token >> 4;
+        if (lit_len == 15 && !lz_read_length(&ip, iend, &lit_len)) {
+            return -1;
+        }
+        if (lit_len > (size_t)(iend - ip) || lit_len > (size_t)(oend - op)) {
+            return -1;
+        }
+        memcpy(op, ip, lit_len);
+        op += lit_len;
+        ip += lit_len;
+        if (ip == iend) {   // The last sequence
+            break;
+        }
+
+        if (iend - ip < 2) {
+            return -1;
+        }
+        unsigned int offset = ip[0] | ip[1] << 8;
+        unsigned int match_len = token & 15;
+        ip += 2;
+        if (match_len == 15 && !lz_read_length(&ip, iend, &match_len)) {
+            return -1;
+        }
+        match_len += LZ_MINMATCH;
+        if (offset == 0 || offset > (size_t)(op - (unsigned char *)dst) || match_len > (size_t)(oend - op)) {
+            return -1;
+        }
+        const unsigned char *ref = op - offset;
+        if (offset >= match_len) {
+            memcpy(op, ref, match_len);
+            op += match_len;
+        } else {   // Overlapping match repeats its start
+            while (match_len--) {
+                *op++ = *ref++;
+            }
+        }
+    }
+    return op - (unsigned char *)dst;
+}
+
+#endif /* LZ_H_ */
+
+/*** End of file lz.h ***/
@@ -0,0 +1,140 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             pool.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file with inline methods of fixed-size packet buffer
+*        pool. Buffers are allocated by slabs and recycled by free list.
+*
+*******************************************************************/
+/**
+* @file pool.h
+*
+* @brief Header file with inline methods of fixed-size packet buffer
+* @brief pool. Buffers are allocated by slabs and recycled by free list.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef POOL_H_
+#define POOL_H_
+
+#include <stdlib.h>
+#include <stddef.h>
+
+#define POOL_ALIGN  64          // Alignment of buffers - cache line
+
+/**
+ * Slab - one allocation of many buffers, slabs are linked for destroying.
+ */
+typedef struct pool_slab {
+    struct pool_slab *next;     /**< next slab */
+} TPoolSlab;
+
+/**
+ * Pool structure.
+ */
+typedef struct {
+    void *free;                 /**< free list, next free buffer is stored inside buffer */
+    TPoolSlab *slabs;           /**< allocated slabs */
+    size_t size;                /**< size of one buffer including alignment */
+    unsigned int slab_count;    /**< number of buffers allocated by next slab */
+    unsigned int used;          /**< number of used buffers */
+} TPool;
+
+/**
+ * Allocates new slab and puts its buffers into free list.
+ * @param pool Pointer to pool.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+static inline int pool_grow(TPool *pool) {
+    size_t header = (sizeof(TPoolSlab) + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    char *slab;
+    if (posix_memalign((void **)&slab, POOL_ALIGN, header + pool->slab_count * pool->size) != 0) {
+        return 0;
+    }
+
+    ((TPoolSlab *)slab)->next = pool->slabs;
+    pool->slabs = (TPoolSlab *)slab;
+    for (unsigned int i = pool->slab_count; i > 0; i--) {
+        char *buff = slab + header + (i - 1) * pool->size;
+        *(void **)buff = pool->free;
+        pool->free = buff;
+    }
+    return 1;
+}
+
+/**
+ * Initializes pool and allocates the first slab.
+ * @param pool Pointer to pool.
+ * @param size Size of one buffer.
+ * @param count Number of buffers allocated at once, pool grows by the same count.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+static inline int pool_init(TPool *pool, size_t size, unsigned int count) {
+    if (size < sizeof(void *)) size = sizeof(void *);
+    pool->size = (size + POOL_ALIGN - 1) & ~(size_t)(POOL_ALIGN - 1);
+    pool->slab_count = count ? count : 1;
+    pool->free = NULL;
+    pool->slabs = NULL;
+    pool->used = 0;
+    return pool_grow(pool);
+}
+
+/**
+ * Allocates slab of buffers at once, e.g. for new slots of grown window.
+ * @param pool Pointer to pool.
+ * @param count Number of buffers to allocate, pool grows by the same count later.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+static inline int pool_reserve(TPool *pool, unsigned int count) {
+    pool->slab_count = count ? count : 1;
+    return pool_grow(pool);
+}
+
+/**
+ * Takes buffer from pool, heap is touched only whether pool is exhausted.
+ * @param pool Pointer to pool.
+ * @return Returns buffer or NULL on memory allocation fail.
+ */
+static inline void *pool_alloc(TPool *pool) {
+    if (pool->free == NULL && !pool_grow(pool)) {
+        return NULL;
+    }
+    void *buff = pool->free;
+    pool->free = *(void **)buff;
+    pool->used++;
+    return buff;
+}
+
+/**
+ * Returns buffer into pool.
+ * @param pool Pointer to pool.
+ * @param buff Buffer taken by pool_alloc, can be NULL.
+ */
+static inline void pool_free(TPool *pool, void *buff) {
+    if (buff == NULL) return;
+    *(void **)buff = pool->free;
+    pool->free = buff;
+    pool->used--;
+}
+
+/**
+ * Destroyes pool - frees all slabs including used buffers.
+ * @param pool Pointer to pool.
+ */
+static inline void pool_destroy(TPool *pool) {
+    while (pool->slabs != NULL) {
+        TPoolSlab *next = pool->slabs->next;
+        free(pool->slabs);
+        pool->slabs = next;
+    }
+    pool->free = NULL;
+    pool->used = 0;
+}
+
+#endif /* POOL_H_ */
+
+/*** End of file pool.h ***/
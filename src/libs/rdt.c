@@ -0,0 +1,49 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             rdt.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file with checksum implementations selected at runtime,
+*        they are shared by all modules of program.
+*
+*******************************************************************/
+/**
+* @file rdt.c
+*
+* @brief Source file with checksum implementations selected at runtime,
+* @brief they are shared by all modules of program.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include "rdt.h"
+
+checksum_fn checksum_impl = checksumScalar; /**< checksum implementation, selected by checksumInit */
+int crc32c_hw = 0;                          /**< 1 whether is CRC32C computed by SSE4.2 */
+
+/**
+ * Selects the fastest checksum implementation supported by CPU.
+ * @return Returns checksum implementation.
+ */
+static checksum_fn checksumSelect(void) {
+#ifdef RDT_X86
+    if (__builtin_cpu_supports("avx2")) return checksumAvx2;
+    if (__builtin_cpu_supports("sse2")) return checksumSse2;
+#endif
+    return checksumScalar;
+}
+
+/**
+ * Selects checksum implementations supported by CPU. It has to be called
+ * by main before threads start, reference implementations are used until then.
+ */
+void checksumInit(void) {
+    checksum_impl = checksumSelect();
+#ifdef RDT_X86
+    crc32c_hw = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+/*** End of file rdt.c ***/
@@ -24,20 +24,67 @@
 #include <limits.h>
 #include <errno.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+#include <arpa/inet.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define RDT_X86       1           // SIMD checksums are available, selected at runtime
+#endif
 
 #define SUM_OFFSET    0           // Offset of checksum
-#define SEQ_OFFSET    2           // Offset of sequence number
-#define LEN_OFFSET    6           // Offset of data length number
-#define FLAGS_OFFSET  8           // Packet flags offset
+#define SEQ_OFFSET    4           // Offset of sequence number
+#define CONN_OFFSET   8           // Offset of connection ID
+#define LEN_OFFSET   12           // Offset of data length number
+#define FLAGS_OFFSET 14           // Packet flags offset
+
+#define HEADER_OFFSET 4           // Header offset - without checksum
+#define DATA_OFFSET  16           // Data offset
+#define PACKET_ALIGN  4           // Alignment of packet start - header fields are loaded aligned
+
+#define MAX_PACKETSIZE 65507                          // Max size of UDP datagram payload
+#define MAX_DATASIZE   (MAX_PACKETSIZE - DATA_OFFSET) // Max length of packet data
+#define DEF_DATASIZE   1400                           // Default length of data - fits into ethernet MTU
+#define MIN_DATASIZE   536                            // Length of data always accepted - packets sent before SYN answer
 
-#define HEADER_OFFSET 2           // Header offset - without checksum
-#define DATA_OFFSET  10           // Data offset
+#define SACK_BLOCKS    16                             // Max number of SACK blocks inside ACK packet
+#define SACK_BLOCKSIZE 8                              // Size of one SACK block - first and behind last sequence
+#define ACK_PACKETSIZE (DATA_OFFSET + SACK_BLOCKS * SACK_BLOCKSIZE) // Max size of ACK packet
+
+#define FEC_BLOCKMAX   64                             // Max number of data packets protected by one parity packet
+#define FEC_HEADER     6                              // Size of parity header - XOR of lengths and flags, number of packets
+#define FEC_DATASIZE   (MAX_DATASIZE - FEC_HEADER)    // Max length of data protected by parity
 
 /**
- * Packet structure.
+ * Wire header of packet in network byte order. Every field is naturally
+ * aligned and packet buffers start on PACKET_ALIGN address, so it is read
+ * by single load and byte swap. Coalesced packets at unaligned offset have
+ * to be copied before parsing.
+ */
+typedef struct {
+    uint32_t sum;            /**< checksum of the rest of packet */
+    uint32_t seq;            /**< sequence number of packet */
+    uint32_t conn;           /**< connection ID chosen by sender */
+    uint16_t len;            /**< data length */
+    uint16_t flags;          /**< flags */
+} RDTHeader;
+
+// Header has to match wire offsets without padding - compilation fails otherwise
+__extension__ _Static_assert(sizeof(RDTHeader) == DATA_OFFSET, "RDTHeader has to match DATA_OFFSET");
+__extension__ _Static_assert(offsetof(RDTHeader, sum) == SUM_OFFSET, "RDTHeader sum has to match SUM_OFFSET");
+__extension__ _Static_assert(offsetof(RDTHeader, seq) == SEQ_OFFSET, "RDTHeader seq has to match SEQ_OFFSET");
+__extension__ _Static_assert(offsetof(RDTHeader, conn) == CONN_OFFSET, "RDTHeader conn has to match CONN_OFFSET");
+__extension__ _Static_assert(offsetof(RDTHeader, len) == LEN_OFFSET, "RDTHeader len has to match LEN_OFFSET");
+__extension__ _Static_assert(offsetof(RDTHeader, flags) == FLAGS_OFFSET, "RDTHeader flags has to match FLAGS_OFFSET");
+
+/**
+ * Packet structure - decoded header, data point behind header of the packet.
  */
 typedef struct packet {
     unsigned int   seq;      /**< sequence number of packet */
+    unsigned int   conn;     /**< connection ID */
     unsigned short len;      /**< data length */
     unsigned short flags;    /**< flags */
     char *data;              /**< transfering data */
@@ -49,60 +96,67 @@ typedef struct packet {
 enum flags {
     ACK          = 0x01,     /**< enum packet with ACK */
     NACK         = 0x02,     /**< enum packet with NACK */
-    END          = 0x04      /**< enum packet finishing transfer */
-    // 0x08, 0x0F etc...
+    FIN          = 0x04,     /**< enum end of transfer behind the last data, answered by FIN with ACK */
+    SACK         = 0x08,     /**< enum ACK/NACK carrying SACK blocks as data */
+    CRC          = 0x10,     /**< enum packet protected by CRC32C instead of ones' complement sum */
+    SYN          = 0x20,     /**< enum connection setup carrying parameters, answered by SYN with ACK */
+    FEC          = 0x40,     /**< enum XOR parity of block of data packets, sequence is the first of block */
+    LZ           = 0x80,     /**< enum data compressed by LZ codec, each packet alone */
+    RST          = 0x100     /**< enum SYN refused - connection ID is used, with FIN server accepts no connection */
+    // 0x200 etc...
 };
 
 /**
- * Converts unsigned short type into 2-item char array.
- * @param number Number to be converted.
- * @param bytes Pointer to array where converted number will be stored. 
+ * Enum of features negotiated by SYN.
  */
-static inline void ushort2bytes(unsigned short number, char *bytes) {
-    bytes[0] = (number >> 8) & 0xFF;
-    bytes[1] = number & 0xFF; 
-}   
+enum features {
+    FEAT_SACK    = 0x01,     /**< enum ACK/NACK can carry SACK blocks */
+    FEAT_CRC     = 0x02,     /**< enum packets are protected by CRC32C */
+    FEAT_SR      = 0x04,     /**< enum Selective Repeat - out-of-order packets are buffered, Go-Back-N otherwise */
+    FEAT_LZ      = 0x08      /**< enum data packets can be compressed */
+};
 
 /**
- * Converts unsigned short stored in 2-item char array into unsigned short datatype.
- * @param bytes Pointer to array where is stored coded number. 
- * @return Converted unsigned short.
+ * Wire format of SYN data in network byte order.
  */
-static inline unsigned short bytes2ushort (char *bytes) {
-    return ((unsigned char)bytes[0] << 8) + (unsigned char)bytes[1];
-}
+typedef struct __attribute__((packed)) {
+    uint32_t window;         /**< max number of packets in flight */
+    uint32_t data_size;      /**< max length of data inside one packet */
+    uint32_t features;       /**< features - FEAT_* */
+    uint32_t fec_block;      /**< number of data packets protected by one parity, 0 without FEC */
+} RDTSyn;
 
-/** Converts unsigned int type into 4-item char array.
- * @param number Number to be converted.
- * @param bytes Pointer to array where converted number will be stored. 
+/**
+ * Connection parameters - proposed by client SYN, accepted by server answer.
  */
-static inline void uint2bytes(unsigned int number, char *bytes) {
-    bytes[0] = (number >> 24) & 0xFF;
-    bytes[1] = (number >> 16) & 0xFF;
-    bytes[2] = (number >> 8) & 0xFF;
-    bytes[3] = number & 0xFF; 
-}
+typedef struct {
+    unsigned int window;     /**< max number of packets in flight */
+    unsigned int data_size;  /**< max length of data inside one packet */
+    unsigned int features;   /**< features - FEAT_* */
+    unsigned int fec_block;  /**< number of data packets protected by one parity, 0 without FEC */
+} RDTParams;
 
 /**
- * Converts unsigned int stored in 4-item char array into unsigned int datatype.
- * @param bytes Pointer to array where is stored coded number. 
- * @return Converted unsigned int.
+ * Wire format of parity header in network byte order, XOR of data follows.
  */
-static inline unsigned int bytes2uint (char *bytes) {
-    return ((unsigned char)bytes[0] << 24) + ((unsigned char)bytes[1] << 16) +
-           ((unsigned char)bytes[2] << 8) + (unsigned char)bytes[3];
-}
+typedef struct __attribute__((packed)) {
+    uint16_t lens;           /**< XOR of data lengths of protected packets */
+    uint16_t flags;          /**< XOR of data flags (LZ) of protected packets */
+    uint16_t count;          /**< number of protected packets - block can be shorter at the end */
+} RDTFec;
 
-/*
- * Source code took from RFC 1071 and edited.
- * See: http://www.faqs.org/rfcs/rfc1071.html
- * @param packet Packet from which will be checksum calculated.
- * @param size Size of packet.
- * @return Checksum of packet.  
-*/
-static inline unsigned short checksum(unsigned char *packet, size_t size) {
-    register long sum = 0; // Using fully architecture as possible
-    unsigned short *_packet = (unsigned short *) packet;
+// Parity header has to match its size - compilation fails otherwise
+typedef char RDTFecSize[sizeof(RDTFec) == FEC_HEADER ? 1 : -1];
+
+/**
+ * Adds 16-bit words of data to wide ones' complement sum.
+ * @param sum Current sum.
+ * @param packet Data to be summed.
+ * @param size Size of data.
+ * @return Returns new sum, it has to be folded.
+ */
+static inline uint64_t sumWords(uint64_t sum, const unsigned char *packet, size_t size) {
+    const unsigned short *_packet = (const unsigned short *) packet;
     
     /* Do it quickly - UNFOLDED - but depends on architecture */
     while(size > 1)  {
@@ -112,35 +166,206 @@ static inline unsigned short checksum(unsigned char *packet, size_t size) {
 
     /* Do sum of the rest last byte whether exists */
     if( size > 0 )
-        sum += *(unsigned char *)_packet;
+        sum += *(const unsigned char *)_packet;
+    return sum;
+}
 
-    /* Fold 32-bit sum to 16 bits */
+/**
+ * Folds wide ones' complement sum to 16 bits and complements it.
+ * @param sum Wide sum.
+ * @return Checksum.
+ */
+static inline unsigned short foldSum(uint64_t sum) {
     while (sum>>16)
         sum = (sum & 0xffff) + (sum >> 16);
-               
     return ~sum;
 }
 
+/*
+ * Source code took from RFC 1071 and edited - reference implementation.
+ * See: http://www.faqs.org/rfcs/rfc1071.html
+ * @param packet Packet from which will be checksum calculated.
+ * @param size Size of packet.
+ * @return Checksum of packet.  
+*/
+static inline unsigned short checksumScalar(const unsigned char *packet, size_t size) {
+    return foldSum(sumWords(0, packet, size));
+}
+
+#ifdef RDT_X86
+/**
+ * SSE2 version of checksum - words are widened into 32-bit lanes, lanes
+ * are summed up before they can overflow.
+ * @param packet Packet from which will be checksum calculated.
+ * @param size Size of packet.
+ * @return Checksum of packet.  
+ */
+__attribute__((target("sse2")))
+static inline unsigned short checksumSse2(const unsigned char *packet, size_t size) {
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    uint32_t lanes[4];
+
+    while (size >= 16) {
+        size_t blocks = size / 16 < 4096 ? size / 16 : 4096;  // 8192 words per lane fits
+        __m128i acc = zero;
+        size -= blocks * 16;
+        while (blocks--) {
+            __m128i v = _mm_loadu_si128((const __m128i *) packet);
+            acc = _mm_add_epi32(acc, _mm_unpacklo_epi16(v, zero));
+            acc = _mm_add_epi32(acc, _mm_unpackhi_epi16(v, zero));
+            packet += 16;
+        }
+        _mm_storeu_si128((__m128i *) lanes, acc);
+        sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+    return foldSum(sumWords(sum, packet, size));
+}
+
+/**
+ * AVX2 version of checksum - words are widened into 32-bit lanes, lanes
+ * are summed up before they can overflow.
+ * @param packet Packet from which will be checksum calculated.
+ * @param size Size of packet.
+ * @return Checksum of packet.  
+ */
+__attribute__((target("avx2")))
+static inline unsigned short checksumAvx2(const unsigned char *packet, size_t size) {
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    uint32_t lanes[8];
+
+    while (size >= 32) {
+        size_t blocks = size / 32 < 4096 ? size / 32 : 4096;  // 8192 words per lane fits
+        __m256i acc = zero;
+        size -= blocks * 32;
+        while (blocks--) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) packet);
+            acc = _mm256_add_epi32(acc, _mm256_unpacklo_epi16(v, zero));
+            acc = _mm256_add_epi32(acc, _mm256_unpackhi_epi16(v, zero));
+            packet += 32;
+        }
+        _mm256_storeu_si256((__m256i *) lanes, acc);
+        for (int i = 0; i < 8; i++) {
+            sum += lanes[i];
+        }
+    }
+    return foldSum(sumWords(sum, packet, size));
+}
+
+/**
+ * CRC32C by SSE4.2 instruction.
+ * @param crc Initial value.
+ * @param data Data from which will be CRC calculated.
+ * @param size Size of data.
+ * @return Returns CRC without final complement.
+ */
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32cHw(uint32_t crc, const unsigned char *data, size_t size) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc, word;
+    while (size >= 8) {
+        memcpy(&word, data, 8);
+        crc64 = _mm_crc32_u64(crc64, word);
+        data += 8;
+        size -= 8;
+    }
+    crc = crc64;
+#endif
+    while (size--) {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#endif /* RDT_X86 */
+
+/**
+ * CRC32C (Castagnoli) computed bit by bit - reference implementation.
+ * @param crc Initial value.
+ * @param data Data from which will be CRC calculated.
+ * @param size Size of data.
+ * @return Returns CRC without final complement.
+ */
+static inline uint32_t crc32cSw(uint32_t crc, const unsigned char *data, size_t size) {
+    while (size--) {
+        crc ^= *data++;
+        for (int k = 0; k < 8; k++) {
+            crc = (crc >> 1) ^ (0x82F63B78 & -(crc & 1));
+        }
+    }
+    return crc;
+}
+
+/**
+ * Type of checksum implementation.
+ */
+typedef unsigned short (*checksum_fn)(const unsigned char *packet, size_t size);
+
+extern checksum_fn checksum_impl; /**< checksum implementation, selected by checksumInit - rdt.c */
+extern int crc32c_hw;             /**< 1 whether is CRC32C computed by SSE4.2 - rdt.c */
+
+/**
+ * Selects checksum implementations supported by CPU. It has to be called
+ * by main before threads start, reference implementations are used until then.
+ */
+void checksumInit(void);
+
+/**
+ * Calculates ones' complement checksum (RFC 1071) by the fastest implementation.
+ * @param packet Packet from which will be checksum calculated.
+ * @param size Size of packet.
+ * @return Checksum of packet.  
+ */
+static inline unsigned short checksum(unsigned char *packet, size_t size) {
+    return checksum_impl(packet, size);
+}
+
+/**
+ * Calculates CRC32C by SSE4.2 instruction whether CPU supports it.
+ * @param data Data from which will be CRC calculated.
+ * @param size Size of data.
+ * @return Returns CRC32C.
+ */
+static inline uint32_t crc32c(const unsigned char *data, size_t size) {
+#ifdef RDT_X86
+    if (crc32c_hw) return ~crc32cHw(~0U, data, size);
+#endif
+    return ~crc32cSw(~0U, data, size);
+}
+
 /**
- * Calculates checksum and comapares with checksum sotred inside packet.
- * @param packet Packet which will be tested.
+ * Calculates checksum of packet header and data, CRC flag selects CRC32C
+ * instead of ones' complement sum.
+ * @param packet Packet with filled header.
  * @param len Size of packet.
- * @return Return 1 whether checksum passed else returns 0.
+ * @return Checksum of packet.
  */
-static inline int testCheckSum(char *packet, unsigned short len) {
-    return checksum((unsigned char *)&packet[HEADER_OFFSET], len - HEADER_OFFSET) == bytes2ushort(packet); 
+static inline uint32_t packetSum(char *packet, size_t len) {
+    unsigned char *data = (unsigned char *)&packet[HEADER_OFFSET];
+    if (ntohs(((RDTHeader *)packet)->flags) & CRC) {
+        return crc32c(data, len - HEADER_OFFSET);
+    }
+    return checksum(data, len - HEADER_OFFSET);
 }
 
 /**
- * Retrieves data from packet.
- * @param packet Packet containing data.
- * @param data Pointer where data will be stored.
- * @return Return size of packet data.
+ * Decodes header of recieved packet just once and checks it.
+ * @param packet Recieved packet.
+ * @param n Length of recieved packet.
+ * @param view Pointer where will be stored decoded header, data point inside packet.
+ * @return Return 1 whether is packet complete and checksum passed else returns 0.
  */
-static inline size_t getData(char *packet, char *data) {
-    unsigned short int len = bytes2ushort(&packet[LEN_OFFSET]);
-    memcpy(data, &packet[DATA_OFFSET], len); 
-    return len;
+static inline int parsePacket(char *packet, size_t n, RDTPacket *view) {
+    const RDTHeader *header = (const RDTHeader *)packet;
+
+    if (n < DATA_OFFSET) return 0;
+    view->seq = ntohl(header->seq);
+    view->conn = ntohl(header->conn);
+    view->len = ntohs(header->len);
+    view->flags = ntohs(header->flags);
+    view->data = &packet[DATA_OFFSET];
+    return DATA_OFFSET + (size_t)view->len <= n &&
+           packetSum(packet, DATA_OFFSET + view->len) == ntohl(header->sum);
 }
 
 /**
@@ -150,7 +375,7 @@ static inline size_t getData(char *packet, char *data) {
  * @return Returns 1 whether packet has defined flags else returns 0.
  */
 static inline int hasFlags(char *packet, unsigned short flags) {
-    return bytes2ushort(&packet[FLAGS_OFFSET]) & flags;
+    return ntohs(((RDTHeader *)packet)->flags) & flags;
 }
 
 /**
@@ -159,7 +384,16 @@ static inline int hasFlags(char *packet, unsigned short flags) {
  * @return Returns sequence number from packet.
  */
 static inline unsigned int seqNumber(char *packet) {
-    return bytes2uint(&packet[SEQ_OFFSET]);
+    return ntohl(((RDTHeader *)packet)->seq);
+}
+
+/**
+ * Returns connection ID from packet.
+ * @param packet Pointer to packett.
+ * @return Returns connection ID from packet.
+ */
+static inline unsigned int connId(char *packet) {
+    return ntohl(((RDTHeader *)packet)->conn);
 }
 
 /**
@@ -168,7 +402,7 @@ static inline unsigned int seqNumber(char *packet) {
  * @return Returns packet size.
  */
 static inline unsigned short packetLen(char *packet) {
-    return DATA_OFFSET + bytes2ushort(&packet[LEN_OFFSET]);
+    return DATA_OFFSET + ntohs(((RDTHeader *)packet)->len);
 }
 
 /**
@@ -177,26 +411,155 @@ static inline unsigned short packetLen(char *packet) {
  * @return Returns data length from packet.
  */
 static inline unsigned short dataLen(char *packet) {
-    return bytes2ushort(&packet[LEN_OFFSET]);
+    return ntohs(((RDTHeader *)packet)->len);
 }
 
-static inline char *makePacket(RDTPacket packet) {
-    char *_packet = malloc(DATA_OFFSET + packet.len);
-    
-    if (_packet == NULL) return 0;
-    
-    memset(_packet, 0,DATA_OFFSET + packet.len); 
+/**
+ * Returns number of SACK blocks inside ACK/NACK packet.
+ * @param packet Pointer to packet.
+ * @return Returns number of SACK blocks.
+ */
+static inline int sackCount(char *packet) {
+    return hasFlags(packet, SACK) ? dataLen(packet) / SACK_BLOCKSIZE : 0;
+}
+
+/**
+ * Retrieves SACK block from ACK/NACK packet - range of buffered sequences.
+ * @param packet Pointer to packet.
+ * @param i Index of block.
+ * @param start Pointer where will be stored first sequence of block.
+ * @param end Pointer where will be stored sequence behind last one of block.
+ */
+static inline void sackBlock(char *packet, int i, unsigned int *start, unsigned int *end) {
+    uint32_t block[2];
+    memcpy(block, &packet[DATA_OFFSET + i * SACK_BLOCKSIZE], SACK_BLOCKSIZE);
+    *start = ntohl(block[0]);
+    *end = ntohl(block[1]);
+}
+
+/**
+ * Codes SACK blocks as data of ACK/NACK packet.
+ * @param blocks Array of first and behind last sequences of blocks.
+ * @param cnt Number of blocks.
+ * @param data Pointer where will be stored coded blocks.
+ * @return Returns length of coded data.
+ */
+static inline unsigned short sackData(unsigned int *blocks, int cnt, char *data) {
+    for (int i = 0; i < 2 * cnt; i++) {
+        uint32_t number = htonl(blocks[i]);
+        memcpy(&data[i * 4], &number, sizeof(number));
+    }
+    return cnt * SACK_BLOCKSIZE;
+}
+
+/**
+ * Codes connection parameters as data of SYN packet.
+ * @param params Connection parameters.
+ * @param data Pointer where will be stored coded parameters.
+ * @return Returns length of coded data.
+ */
+static inline unsigned short synData(RDTParams *params, char *data) {
+    RDTSyn *syn = (RDTSyn *)data;
+    syn->window = htonl(params->window);
+    syn->data_size = htonl(params->data_size);
+    syn->features = htonl(params->features);
+    syn->fec_block = htonl(params->fec_block);
+    return sizeof(RDTSyn);
+}
+
+/**
+ * Retrieves connection parameters from decoded SYN packet.
+ * @param packet Decoded SYN packet.
+ * @param params Pointer where will be stored parameters.
+ * @return Returns 1 on success or 0 whether are parameters missing or invalid.
+ */
+static inline int parseSyn(RDTPacket *packet, RDTParams *params) {
+    const RDTSyn *syn = (const RDTSyn *)packet->data;
+    if (packet->len < sizeof(RDTSyn)) {
+        return 0;
+    }
+    params->window = ntohl(syn->window);
+    params->data_size = ntohl(syn->data_size);
+    params->features = ntohl(syn->features);
+    params->fec_block = ntohl(syn->fec_block);
+    return params->window > 0 && params->data_size > 0 && params->data_size <= MAX_DATASIZE;
+}
+
+/**
+ * XORs data into buffer by whole words, parity of packets is built this way.
+ * @param dst Buffer of at least len bytes.
+ * @param src Data to be added.
+ * @param len Length of data.
+ */
+static inline void xorData(char *dst, const char *src, unsigned int len) {
+    uint64_t a, b;
+    unsigned int i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        memcpy(&a, &dst[i], sizeof(a));
+        memcpy(&b, &src[i], sizeof(b));
+        a ^= b;
+        memcpy(&dst[i], &a, sizeof(a));
+    }
+    for (; i < len; i++) {
+        dst[i] ^= src[i];
+    }
+}
+
+/**
+ * Codes parity header in front of XOR of data.
+ * @param lens XOR of data lengths of protected packets.
+ * @param flags XOR of data flags of protected packets.
+ * @param count Number of protected packets.
+ * @param data Pointer where will be stored parity header.
+ */
+static inline void fecData(unsigned short lens, unsigned short flags, unsigned short count, char *data) {
+    RDTFec *fec = (RDTFec *)data;
+    fec->lens = htons(lens);
+    fec->flags = htons(flags);
+    fec->count = htons(count);
+}
+
+/**
+ * Retrieves parity header from decoded parity packet.
+ * @param packet Decoded parity packet.
+ * @param lens Pointer where will be stored XOR of data lengths.
+ * @param flags Pointer where will be stored XOR of data flags.
+ * @param count Pointer where will be stored number of protected packets.
+ * @return Returns 1 on success or 0 whether is header missing or invalid.
+ */
+static inline int parseFec(RDTPacket *packet, unsigned short *lens, unsigned short *flags, unsigned short *count) {
+    const RDTFec *fec = (const RDTFec *)packet->data;
+    if (packet->len < sizeof(RDTFec)) {
+        return 0;
+    }
+    *lens = ntohs(fec->lens);
+    *flags = ntohs(fec->flags);
+    *count = ntohs(fec->count);
+    return *count > 0 && *count <= FEC_BLOCKMAX;
+}
+
+/**
+ * Encodes packet into buffer, every byte of header is written so buffer
+ * does not need to be cleared.
+ * @param packet Packet structure.
+ * @param buffer Buffer of at least DATA_OFFSET + packet.len bytes. Data can
+ *               be already placed behind header (headroom), then they are not copied.
+ * @return Returns encoded packet - the buffer.
+ */
+static inline char *encodePacket(RDTPacket packet, char *buffer) {
+    RDTHeader *header = (RDTHeader *)buffer;
 
-    uint2bytes(packet.seq, &_packet[SEQ_OFFSET]);
-    ushort2bytes(packet.len, &_packet[LEN_OFFSET]);
-    ushort2bytes(packet.flags, &_packet[FLAGS_OFFSET]);
-    if (packet.len) {
-        memcpy(&_packet[DATA_OFFSET], packet.data, packet.len);
+    header->seq = htonl(packet.seq);
+    header->conn = htonl(packet.conn);
+    header->len = htons(packet.len);
+    header->flags = htons(packet.flags);
+    if (packet.len && packet.data != &buffer[DATA_OFFSET]) {
+        memcpy(&buffer[DATA_OFFSET], packet.data, packet.len);
     }
-    ushort2bytes(checksum((unsigned char *)&_packet[HEADER_OFFSET], DATA_OFFSET + packet.len - HEADER_OFFSET), _packet);
-    return _packet;
+    header->sum = htonl(packetSum(buffer, DATA_OFFSET + packet.len));
+    return buffer;
 }
 
-#endif /* UDT_H_ */
+#endif /* RDT_H_ */
 
-/*** End of file udt.h ***/
+/*** End of file rdt.h ***/
@@ -17,6 +17,61 @@
 #include <sys/socket.h>
 #include <sys/stat.h>
 #include <netinet/in.h>
+#include <errno.h>
+#include <netinet/udp.h>
+#include <linux/filter.h>
+
+/* Max number of datagrams moved by one batch syscall. */
+#define UDT_BATCH 64
+
+/* Segmentation offload, options are missing in older headers. */
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#define UDT_GSO_SEGMENTS 64      /* Max datagrams of one offloaded buffer */
+#define UDT_GSO_SIZE     65000   /* Max length of one offloaded buffer */
+#define UDT_GRO_SIZE     65536   /* Receiving buffer length for coalesced datagrams */
+
+/* Requested socket buffers, kernel limits them by net.core.[rw]mem_max. */
+#define UDT_SOCKBUF (4 * 1024 * 1024)
+
+/* Socket sharding, options are missing in older headers. */
+#ifndef SO_REUSEPORT
+#define SO_REUSEPORT 15
+#endif
+#ifndef SO_ATTACH_REUSEPORT_CBPF
+#define SO_ATTACH_REUSEPORT_CBPF 51
+#endif
+
+/*
+ * Datagram of a batch.
+ * buff - A buffer with RDT packet or for the received one.
+ * nbytes - Length of the packet, udt_recv_batch() stores received length there.
+ * addr, port - Remote node, filled by udt_recv_batch(). Port 0 sends to the peer
+ *              of connected socket without any address handling.
+ */
+typedef struct {
+	void *buff;
+	size_t nbytes;
+	in_addr_t addr;
+	in_port_t port;
+} udt_datagram;
+
+/*
+ * Enlarges socket buffers, so a window burst is not dropped by the socket
+ * itself. Refused size keeps the system default.
+ * udt - Determines UDT descriptor.
+ */
+static inline void udt_buffers(int udt)
+{
+	int size = UDT_SOCKBUF;
+	setsockopt(udt, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+	setsockopt(udt, SOL_SOCKET, SO_SNDBUF, &size, sizeof(size));
+}
+
 /*
  * Returns UDT descriptor or NULL if error occurred.
  * local_port - Specifies a local port to which UDT binds.
@@ -29,6 +84,7 @@ static inline int udt_init(in_port_t local_port)
 		fprintf(stderr, "UDT: Cannot create UDT descriptor.");
 		exit(EXIT_FAILURE);
 	}
+	udt_buffers(udt);
 	struct sockaddr_in sa;
 	bzero(&sa, sizeof(sa));
 	sa.sin_family = AF_INET;
@@ -42,6 +98,81 @@ static inline int udt_init(in_port_t local_port)
 	return udt;
 }
 
+/*
+ * Returns UDT descriptor connected to the single remote node, it has to be used
+ * with udt_send_conn(), udt_recv_conn() or batch functions with port 0.
+ * local_port - Specifies a local port to which UDT binds.
+ * addr - Ip address of the remote node.
+ * port - Port on the remote node.
+ */
+static inline int udt_init_conn(in_port_t local_port, in_addr_t addr, in_port_t port)
+{
+	int udt = udt_init(local_port);
+	struct sockaddr_in sa;
+	bzero(&sa, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(addr);
+	sa.sin_port = htons(port);
+	if (connect(udt, (const struct sockaddr *) &sa, sizeof(sa)) == -1) {
+		fprintf(stderr, "UDT: Cannot connect to the specified node.");
+		exit(EXIT_FAILURE);
+	}
+	return udt;
+}
+
+/*
+ * Returns UDT descriptor sharing the local port with other descriptors of
+ * the same process (SO_REUSEPORT), kernel spreads incoming flows among them.
+ * local_port - Specifies a local port to which UDT binds.
+ */
+static inline int udt_init_reuseport(in_port_t local_port)
+{
+	int udt = socket(AF_INET, SOCK_DGRAM, 0);
+	int on = 1;
+	if (udt <= 0) {
+		fprintf(stderr, "UDT: Cannot create UDT descriptor.");
+		exit(EXIT_FAILURE);
+	}
+	fcntl(udt, F_SETFL, O_NONBLOCK);
+	if (setsockopt(udt, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+		fprintf(stderr, "UDT: Cannot share the specified port.");
+		exit(EXIT_FAILURE);
+	}
+	udt_buffers(udt);
+	struct sockaddr_in sa;
+	bzero(&sa, sizeof(sa));
+	sa.sin_family = AF_INET;
+	sa.sin_addr.s_addr = htonl(0);
+	sa.sin_port = htons(local_port);
+	if (bind(udt, (const struct sockaddr *) &sa, sizeof(sa)) == -1) {
+		fprintf(stderr, "UDT: Cannot bind to the specified port.");
+		exit(EXIT_FAILURE);
+	}
+	return udt;
+}
+
+/*
+ * Steers datagrams among descriptors sharing the port by a 32-bit number
+ * inside the datagram (classic BPF program), so a flow stays on one
+ * descriptor even when its source address changes. Descriptor index is
+ * the number modulo count, descriptors are indexed in order of binding.
+ * udt - Any descriptor of the group as initialized by udt_init_reuseport().
+ * count - Number of descriptors in the group.
+ * offset - Offset of the big-endian number inside the datagram payload.
+ *
+ * Returns 1 if program was attached or 0 if kernel hashing stays in use.
+ */
+static inline int udt_steer_reuseport(int udt, unsigned int count, unsigned int offset)
+{
+	struct sock_filter code[] = {
+		{ BPF_LD | BPF_W | BPF_ABS, 0, 0, offset },   /* A = number, 0 if datagram is short */
+		{ BPF_ALU | BPF_MOD | BPF_K, 0, 0, count },   /* A = A % count */
+		{ BPF_RET | BPF_A, 0, 0, 0 }                  /* index of descriptor */
+	};
+	struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+	return setsockopt(udt, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
+
 /*
  * Reads a received datagram in UDT buffer pool, if such exists.
  * udt - Determines UDT descriptor as initialized by udt_init() function.
@@ -98,4 +229,226 @@ static inline int udt_send(int udt, in_addr_t addr, in_port_t port, void *buff,
 	return nsend == (ssize_t)nbytes;
 }
 
+/*
+ * Reads up to count received datagrams by one syscall (recvmmsg).
+ * udt - Determines UDT descriptor as initialized by udt_init() function.
+ * dgrams - Array of datagrams, buff and nbytes have to specify buffers,
+ *          nbytes, addr and port are filled for received datagrams.
+ * count - Number of datagrams in array, at most UDT_BATCH are read.
+ *
+ * Returns the number of received datagrams or 0 no packet were read.
+ */
+static inline int udt_recv_batch(int udt, udt_datagram *dgrams, unsigned int count)
+{
+	struct mmsghdr msgs[UDT_BATCH];
+	struct iovec iovs[UDT_BATCH];
+	struct sockaddr_in sas[UDT_BATCH];
+
+	if (count > UDT_BATCH) count = UDT_BATCH;
+	for (unsigned int i = 0; i < count; i++) {
+		iovs[i].iov_base = dgrams[i].buff;
+		iovs[i].iov_len = dgrams[i].nbytes;
+		bzero(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+		msgs[i].msg_hdr.msg_iov = &iovs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &sas[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sas[i]);
+	}
+	int nrecv = recvmmsg(udt, msgs, count, MSG_DONTWAIT, NULL);
+	if (nrecv < 0) return 0;
+	for (int i = 0; i < nrecv; i++) {
+		dgrams[i].nbytes = msgs[i].msg_len;
+		dgrams[i].addr = ntohl(sas[i].sin_addr.s_addr);
+		dgrams[i].port = ntohs(sas[i].sin_port);
+	}
+	return nrecv;
+}
+
+/*
+ * Sends datagrams by as few syscalls as possible (sendmmsg).
+ * udt - Determines UDT descriptor as initialized by udt_init() function.
+ * dgrams - Array of datagrams with RDT packets and their remote nodes.
+ * count - Number of datagrams in array.
+ *
+ * Returns the number of sent datagrams - less than count whether socket buffer
+ * is full, or -1 if a problem occurred.
+ */
+static inline int udt_send_batch(int udt, udt_datagram *dgrams, unsigned int count)
+{
+	struct mmsghdr msgs[UDT_BATCH];
+	struct iovec iovs[UDT_BATCH];
+	struct sockaddr_in sas[UDT_BATCH];
+	unsigned int sent = 0;
+
+	while (sent < count) {
+		unsigned int n = count - sent < UDT_BATCH ? count - sent : UDT_BATCH;
+		for (unsigned int i = 0; i < n; i++) {
+			udt_datagram *d = &dgrams[sent + i];
+			iovs[i].iov_base = d->buff;
+			iovs[i].iov_len = d->nbytes;
+			bzero(&msgs[i].msg_hdr, sizeof(msgs[i].msg_hdr));
+			msgs[i].msg_hdr.msg_iov = &iovs[i];
+			msgs[i].msg_hdr.msg_iovlen = 1;
+			if (d->port != 0) {   /* Connected socket has the peer already */
+				bzero(&sas[i], sizeof(sas[i]));
+				sas[i].sin_family = AF_INET;
+				sas[i].sin_addr.s_addr = htonl(d->addr);
+				sas[i].sin_port = htons(d->port);
+				msgs[i].msg_hdr.msg_name = &sas[i];
+				msgs[i].msg_hdr.msg_namelen = sizeof(sas[i]);
+			}
+		}
+		int nsend = sendmmsg(udt, msgs, n, 0);
+		if (nsend < 0) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ||
+			    errno == ECONNREFUSED || errno == EINTR) {
+				break;          /* Caller decides about unsent rest */
+			}
+			return -1;
+		}
+		sent += nsend;
+		if ((unsigned int)nsend < n) break;
+	}
+	return sent;
+}
+
+/*
+ * Reads a received datagram from connected UDT, if such exists.
+ * udt - Determines UDT descriptor as initialized by udt_init_conn() function.
+ * buff - A pointer to buffer used for store the available data.
+ * nbytes - Length of the buffer.
+ *
+ * Returns the length of the packet received or 0 no packet were read.
+ */
+static inline int udt_recv_conn(int udt, void *buff, size_t nbytes)
+{
+	ssize_t nrecv = recv(udt, buff, nbytes, MSG_DONTWAIT);
+	return nrecv < 0 ? 0 : nrecv;
+}
+
+/*
+ * Sends a new UDT datagram to the peer of connected UDT.
+ * udt - Determines UDT descriptor as initialized by udt_init_conn() function.
+ * buff - A buffer containing RDT packet.
+ * nbytes - THe lenght of the buffer with data.
+ *
+ * Returns 1 if packet has been successfully send or 0 if a problem occurred,
+ * ECONNREFUSED means that the peer does not listen.
+ */
+static inline int udt_send_conn(int udt, void *buff, size_t nbytes)
+{
+	return send(udt, buff, nbytes, 0) == (ssize_t)nbytes;
+}
+
+/*
+ * Checks whether kernel supports segmentation offload (UDP_SEGMENT).
+ * udt - Determines UDT descriptor as initialized by udt_init() function.
+ *
+ * Returns 1 if udt_send_gso() can offload segmentation or 0.
+ */
+static inline int udt_gso_supported(int udt)
+{
+	int size = 0;
+	socklen_t len = sizeof(size);
+	return getsockopt(udt, SOL_UDP, UDP_SEGMENT, &size, &len) == 0;
+}
+
+/*
+ * Enables receive offload (UDP_GRO), kernel can coalesce equal-sized datagrams
+ * of one flow into one buffer - receiver has to split it. Buffers should
+ * have UDT_GRO_SIZE bytes.
+ * udt - Determines UDT descriptor as initialized by udt_init() function.
+ *
+ * Returns 1 if offload was enabled or 0 if kernel does not support it.
+ */
+static inline int udt_enable_gro(int udt)
+{
+	int on = 1;
+	return setsockopt(udt, SOL_UDP, UDP_GRO, &on, sizeof(on)) == 0;
+}
+
+/*
+ * Sends datagrams with segmentation offload. Runs of equal-sized datagrams
+ * to the same node are passed to kernel as one buffer which is split into
+ * datagrams by kernel (or NIC). Falls back to udt_send_batch() whether
+ * kernel refuses offload.
+ * udt - Determines UDT descriptor as initialized by udt_init() function.
+ * dgrams - Array of datagrams with RDT packets and their remote nodes.
+ * count - Number of datagrams in array, at most UDT_BATCH are sent.
+ *
+ * Returns the number of sent datagrams - less than count whether socket buffer
+ * is full, or -1 if a problem occurred.
+ */
+static inline int udt_send_gso(int udt, udt_datagram *dgrams, unsigned int count)
+{
+	struct mmsghdr msgs[UDT_BATCH];
+	struct iovec iovs[UDT_BATCH];
+	struct sockaddr_in sas[UDT_BATCH];
+	char ctrls[UDT_BATCH][CMSG_SPACE(sizeof(uint16_t))];
+	unsigned int segs[UDT_BATCH];
+	unsigned int sent = 0;
+
+	if (count > UDT_BATCH) count = UDT_BATCH;
+	while (sent < count) {
+		unsigned int n = 0, i = sent;
+
+		/* Groups of equal-sized datagrams, the last one can be shorter */
+		while (i < count && n < UDT_BATCH) {
+			size_t size = dgrams[i].nbytes, total = 0;
+			unsigned int first = i;
+			while (i < count && (i == first || (i - first < UDT_GSO_SEGMENTS &&
+			       dgrams[i].port == dgrams[first].port && dgrams[i].addr == dgrams[first].addr &&
+			       dgrams[i].nbytes <= size && total + dgrams[i].nbytes <= UDT_GSO_SIZE))) {
+				total += dgrams[i].nbytes;
+				if (dgrams[i++].nbytes < size) break;
+			}
+			segs[n] = i - first;
+
+			bzero(&msgs[n].msg_hdr, sizeof(msgs[n].msg_hdr));
+			msgs[n].msg_hdr.msg_iov = &iovs[first];
+			msgs[n].msg_hdr.msg_iovlen = segs[n];
+			for (unsigned int j = first; j < i; j++) {
+				iovs[j].iov_base = dgrams[j].buff;
+				iovs[j].iov_len = dgrams[j].nbytes;
+			}
+			if (dgrams[first].port != 0) {
+				bzero(&sas[n], sizeof(sas[n]));
+				sas[n].sin_family = AF_INET;
+				sas[n].sin_addr.s_addr = htonl(dgrams[first].addr);
+				sas[n].sin_port = htons(dgrams[first].port);
+				msgs[n].msg_hdr.msg_name = &sas[n];
+				msgs[n].msg_hdr.msg_namelen = sizeof(sas[n]);
+			}
+			if (segs[n] > 1) {   /* Size of segments for kernel */
+				msgs[n].msg_hdr.msg_control = ctrls[n];
+				msgs[n].msg_hdr.msg_controllen = sizeof(ctrls[n]);
+				struct cmsghdr *cm = CMSG_FIRSTHDR(&msgs[n].msg_hdr);
+				cm->cmsg_level = SOL_UDP;
+				cm->cmsg_type = UDP_SEGMENT;
+				cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+				*(uint16_t *) CMSG_DATA(cm) = size;
+			}
+			n++;
+		}
+
+		int nsend = sendmmsg(udt, msgs, n, 0);
+		if (nsend < 0) {
+			if (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT || errno == EOPNOTSUPP) {
+				int rest = udt_send_batch(udt, &dgrams[sent], count - sent);
+				return rest < 0 ? -1 : (int)sent + rest;   /* No offload */
+			}
+			if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS ||
+			    errno == ECONNREFUSED || errno == EINTR) {
+				break;          /* Caller decides about unsent rest */
+			}
+			return -1;
+		}
+		for (int j = 0; j < nsend; j++) {
+			sent += segs[j];
+		}
+		if (nsend < (int)n) break;
+	}
+	return sent;
+}
+
 #endif /* UDT_H_ */
@@ -0,0 +1,153 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             conn_table.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file defining methods of connection table
+*        - TConnTable struture.
+*
+*******************************************************************/
+/**
+* @file conn_table.c
+*
+* @brief Source file defining methods of connection table
+* @brief - TConnTable struture.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include <stdlib.h>
+#include "conn_table.h"
+
+/**
+ * Returns index of hash bucket - multiplicative hashing, upper bits are used.
+ * @param id Connection ID.
+ * @param bits Number of bucket index bits.
+ * @return Returns index of bucket.
+ */
+static inline unsigned int connHash(unsigned int id, unsigned int bits) {
+    return (unsigned int)(id * 2654435761u) >> (32 - bits);
+}
+
+/**
+ * Initializes empty connection table.
+ * @param table Pointer to table.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+int initTable(TConnTable *table) {
+    table->bits = __builtin_ctz(CONN_BUCKETS);
+    table->count = 0;
+    table->buckets = calloc(CONN_BUCKETS, sizeof(TConn *));
+    return table->buckets != NULL;
+}
+
+/**
+ * Finds connection by its ID.
+ * @param table Pointer to table.
+ * @param id Connection ID.
+ * @return Returns connection or NULL whether does not exist.
+ */
+TConn *findConn(TConnTable *table, unsigned int id) {
+    TConn *conn = table->buckets[connHash(id, table->bits)];
+    while (conn != NULL && conn->id != id) {
+        conn = conn->next;
+    }
+    return conn;
+}
+
+/**
+ * Doubles number of buckets and rehashes connections.
+ * @param table Pointer to table.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+static int growTable(TConnTable *table) {
+    unsigned int bits = table->bits + 1;
+    TConn **buckets = calloc(1u << bits, sizeof(TConn *));
+    if (buckets == NULL) {
+        return 0;
+    }
+
+    for (unsigned int i = 0; i < (1u << table->bits); i++) {
+        TConn *conn = table->buckets[i];
+        while (conn != NULL) {
+            TConn *next = conn->next;
+            unsigned int index = connHash(conn->id, bits);
+            conn->next = buckets[index];
+            buckets[index] = conn;
+            conn = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = buckets;
+    table->bits = bits;
+    return 1;
+}
+
+/**
+ * Creates new connection with empty buffer, table grows whether is full.
+ * @param table Pointer to table.
+ * @param id Connection ID, it cannot exist inside table.
+ * @return Returns new connection or NULL on memory allocation fail.
+ */
+TConn *addConn(TConnTable *table, unsigned int id) {
+    // Load factor 1 - chains stay short
+    if (table->count >= (1u << table->bits) && table->bits < 31) {
+        growTable(table);   // Table can work without growing
+    }
+
+    TConn *conn = calloc(1, sizeof(TConn));
+    if (conn == NULL) {
+        return NULL;
+    }
+    unsigned int index = connHash(id, table->bits);
+    conn->id = id;
+    conn->next = table->buckets[index];
+    table->buckets[index] = conn;
+    table->count++;
+    return conn;
+}
+
+/**
+ * Removes connection from table and destroyes it.
+ * @param table Pointer to table.
+ * @param conn Connection to remove.
+ */
+void removeConn(TConnTable *table, TConn *conn) {
+    TConn **link = &table->buckets[connHash(conn->id, table->bits)];
+    while (*link != NULL && *link != conn) {
+        link = &(*link)->next;
+    }
+    if (*link != NULL) {
+        *link = conn->next;
+        table->count--;
+    }
+    destroyBuffer(&conn->buff);
+    destroyFec(&conn->fec);
+    free(conn);
+}
+
+/**
+ * Destroyes table and all its connections, descriptors are not closed.
+ * @param table Pointer to table.
+ */
+void destroyTable(TConnTable *table) {
+    if (table->buckets == NULL) {
+        return;
+    }
+    for (unsigned int i = 0; i < (1u << table->bits); i++) {
+        while (table->buckets[i] != NULL) {
+            TConn *next = table->buckets[i]->next;
+            destroyBuffer(&table->buckets[i]->buff);
+            destroyFec(&table->buckets[i]->fec);
+            free(table->buckets[i]);
+            table->buckets[i] = next;
+        }
+    }
+    free(table->buckets);
+    table->buckets = NULL;
+    table->count = 0;
+}
+
+/*** End of file conn_table.c ***/
@@ -0,0 +1,114 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             conn_table.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file of connection table - hash table mapping
+*        connection ID to state of connection.
+*
+*******************************************************************/
+/**
+* @file conn_table.h
+*
+* @brief Header file of connection table - hash table mapping
+* @brief connection ID to state of connection.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef CONN_TABLE_H_
+#define CONN_TABLE_H_
+
+#include <stdint.h>
+#include <netinet/in.h>
+#include "rcv_buffer.h"
+#include "fec.h"
+
+#define CONN_BUCKETS 64        // Initial number of hash buckets
+
+/**
+ * Enum of connection state flags.
+ */
+enum conn_flags {
+    CONN_ACK    = 0x01,     /**< enum connection waits for delayed ACK */
+    CONN_DIRTY  = 0x02,     /**< enum connection recieved data by current batch */
+    CONN_FIN    = 0x04,     /**< enum FIN recieved, connection is closed when all data are printed */
+    CONN_WAIT   = 0x08,     /**< enum connection is closed, it only answers repeated FIN */
+    CONN_IDLE   = 0x10      /**< enum connection was closed as idle, client is told it is unknown */
+};
+
+/**
+ * State of one connection.
+ */
+typedef struct conn {
+    struct conn *next;          /**< next connection inside hash bucket */
+    struct conn *next_ack;      /**< next connection waiting for delayed ACK */
+    struct conn *next_dirty;    /**< next connection with data recieved by current batch */
+    struct conn *next_wait;     /**< next closed connection waiting for removal */
+    struct conn *next_idle;     /**< next open connection with later last_active */
+    struct conn *prev_idle;     /**< previous open connection with earlier last_active */
+    int64_t expires;            /**< time in us when is closed connection removed */
+    int64_t last_active;        /**< time in us of the last recieved packet */
+    unsigned int id;            /**< connection ID */
+    in_addr_t addr;             /**< address of the last recieved packet */
+    in_port_t port;             /**< port of the last recieved packet */
+    unsigned short sum_flag;    /**< CRC whether client protects packets by CRC32C */
+    unsigned short flags;       /**< state flags - CONN_* */
+    unsigned short features;    /**< features negotiated by SYN - FEAT_* */
+    unsigned int ack_pending;   /**< number of recieved but unacknowledged packets */
+    unsigned int ack_every;     /**< packets acknowledged by delayed ACK - at most half of window */
+    unsigned int fin_seq;       /**< sequence of FIN - behind the last data */
+    TBuffer buff;               /**< reorder buffer and output */
+    TFec fec;                   /**< decoder of parity packets */
+} TConn;
+
+/**
+ * Connection table structure.
+ */
+typedef struct {
+    TConn **buckets;            /**< hash buckets */
+    unsigned int bits;          /**< number of buckets is 2^bits */
+    unsigned int count;         /**< number of connections */
+} TConnTable;
+
+/**
+ * Initializes empty connection table.
+ * @param table Pointer to table.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+int initTable(TConnTable *table);
+
+/**
+ * Finds connection by its ID.
+ * @param table Pointer to table.
+ * @param id Connection ID.
+ * @return Returns connection or NULL whether does not exist.
+ */
+TConn *findConn(TConnTable *table, unsigned int id);
+
+/**
+ * Creates new connection with empty buffer, table grows whether is full.
+ * @param table Pointer to table.
+ * @param id Connection ID, it cannot exist inside table.
+ * @return Returns new connection or NULL on memory allocation fail.
+ */
+TConn *addConn(TConnTable *table, unsigned int id);
+
+/**
+ * Removes connection from table and destroyes it.
+ * @param table Pointer to table.
+ * @param conn Connection to remove.
+ */
+void removeConn(TConnTable *table, TConn *conn);
+
+/**
+ * Destroyes table and all its connections, descriptors are not closed.
+ * @param table Pointer to table.
+ */
+void destroyTable(TConnTable *table);
+
+#endif /* CONN_TABLE_H_ */
+
+/*** End of file conn_table.h ***/
@@ -0,0 +1,173 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             fec.c
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Source file defining methods of FEC decoder - TFec structure.
+*
+*******************************************************************/
+/**
+* @file fec.c
+*
+* @brief Source file defining methods of FEC decoder - TFec structure.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include "fec.h"
+
+/**
+ * Initializes decoder, storage is allocated with first data.
+ * @param fec Pointer to decoder.
+ * @param block_size Number of data packets protected by one parity, 0 disables FEC.
+ * @param window Number of packets which can be in flight.
+ * @param slot_size Max data length of one packet.
+ */
+void initFec(TFec *fec, unsigned int block_size, unsigned int window, unsigned int slot_size) {
+    fec->blocks = NULL;
+    fec->block_size = block_size;
+    fec->slot_size = slot_size;
+    // Window can start and end inside block
+    fec->count = block_size ? window / block_size + 2 : 0;
+}
+
+/**
+ * Finds state of block, place of older block is reused.
+ * @param fec Pointer to decoder.
+ * @param block Block number.
+ * @return Returns block or NULL whether is block too old or on memory allocation fail.
+ */
+static TFecBlock *fecBlock(TFec *fec, unsigned int block) {
+    if (fec->blocks == NULL && (fec->blocks = calloc(fec->count, sizeof(TFecBlock))) == NULL) {
+        return NULL;
+    }
+    TFecBlock *entry = &fec->blocks[block % fec->count];
+    
+    if (entry->data != NULL && entry->block == block) {
+        return entry;
+    }
+    if (entry->data == NULL) {
+        if ((entry->data = calloc(1, fec->slot_size)) == NULL) {
+            return NULL;
+        }
+    } else if (block < entry->block) {   // Place belongs to newer block already
+        return NULL;
+    } else {
+        memset(entry->data, 0, entry->len);
+    }
+    entry->block = block;
+    entry->count = 0;
+    entry->lens = 0;
+    entry->flags = 0;
+    entry->len = 0;
+    entry->parity = 0;
+    return entry;
+}
+
+/**
+ * Adds recieved data packet into its block, every packet has to be added once.
+ * @param fec Pointer to decoder.
+ * @param seq_num Sequence number of data.
+ * @param data Pointer to data.
+ * @param len Length of data.
+ * @param flags Data flags of packet - LZ.
+ */
+void fecAdd(TFec *fec, unsigned int seq_num, char *data, unsigned short len, unsigned short flags) {
+    TFecBlock *entry = fecBlock(fec, seq_num / fec->block_size);
+    if (entry == NULL || len > fec->slot_size) {
+        return;
+    }
+    xorData(entry->data, data, len);
+    entry->lens ^= len;
+    entry->flags ^= flags;
+    if (entry->len < len) {
+        entry->len = len;
+    }
+    entry->count++;
+}
+
+/**
+ * Adds recieved parity into its block.
+ * @param fec Pointer to decoder.
+ * @param packet Decoded parity packet.
+ * @return Returns 1 on success or 0 whether is parity invalid, repeated or too old.
+ */
+int fecParity(TFec *fec, RDTPacket *packet) {
+    unsigned short lens, flags, count;
+    unsigned short len = packet->len - FEC_HEADER;
+    TFecBlock *entry;
+    
+    if (!parseFec(packet, &lens, &flags, &count) || count > fec->block_size ||
+        len > fec->slot_size || packet->seq % fec->block_size != 0) {
+        return 0;
+    }
+    if ((entry = fecBlock(fec, packet->seq / fec->block_size)) == NULL || entry->parity) {
+        return 0;
+    }
+    xorData(entry->data, &packet->data[FEC_HEADER], len);
+    entry->lens ^= lens;
+    entry->flags ^= flags;
+    if (entry->len < len) {
+        entry->len = len;
+    }
+    entry->parity = count;
+    return 1;
+}
+
+/**
+ * Rebuilds the only lost packet of block whether its parity came. XOR
+ * of parity and all other packets is the lost packet.
+ * @param fec Pointer to decoder.
+ * @param buffer Buffer of recieved data - tells which packet is lost.
+ * @param seq_num Any sequence number of block.
+ * @param packet Pointer where will be stored rebuilt packet, its data point into block.
+ * @return Returns 1 whether was packet rebuilt else 0.
+ */
+int fecRepair(TFec *fec, TBuffer *buffer, unsigned int seq_num, RDTPacket *packet) {
+    unsigned int block = seq_num / fec->block_size;
+    TFecBlock *entry;
+    
+    if (fec->blocks == NULL) {
+        return 0;
+    }
+    entry = &fec->blocks[block % fec->count];
+    if (entry->data == NULL || entry->block != block || entry->parity == 0 ||
+        entry->count + 1 != entry->parity || entry->lens > fec->slot_size) {
+        return 0;
+    }
+    
+    // Lost packet is the only one which is not buffered
+    unsigned int seq = block * fec->block_size;
+    unsigned int end = seq + entry->parity;
+    while (seq < end && isBuffered(buffer, seq)) {
+        seq++;
+    }
+    if (seq == end) {
+        return 0;
+    }
+    packet->seq = seq;
+    packet->len = entry->lens;
+    packet->flags = entry->flags;
+    packet->data = entry->data;
+    return 1;
+}
+
+/**
+ * Destroyes decoder - releases its storage, decoder can be used again.
+ * @param fec Pointer to decoder.
+ */
+void destroyFec(TFec *fec) {
+    if (fec->blocks != NULL) {
+        for (unsigned int i = 0; i < fec->count; i++) {
+            free(fec->blocks[i].data);
+        }
+    }
+    free(fec->blocks);
+    fec->blocks = NULL;
+}
+
+/*** End of file fec.c ***/
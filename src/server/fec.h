@@ -0,0 +1,96 @@
+/*******************************************************************
+* Project:          Implementace zretezeneho RDT
+* Subject:          IPK - Pocitacove komunikace a site
+* File:             fec.h
+* Date:             20.4.2011
+* Lasta modified:   20.4.2011
+* Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*
+* Brief: Header file of FEC decoder - rebuilds lost packet of block
+*        from XOR parity and the rest of block.
+*
+*******************************************************************/
+/**
+* @file fec.h
+*
+* @brief Header file of FEC decoder - rebuilds lost packet of block
+* @brief from XOR parity and the rest of block.
+* @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
+*/
+
+#ifndef FEC_H_
+#define FEC_H_
+
+#include "../libs/rdt.h"
+#include "rcv_buffer.h"
+
+/**
+ * State of one block - recieved data are XORed as they come, so printed
+ * packets are not needed whether parity comes later.
+ */
+typedef struct {
+    char *data;                 /**< XOR of recieved data and parity, NULL whether unused */
+    unsigned int block;         /**< block number - sequence / block size */
+    unsigned short count;       /**< number of recieved data packets */
+    unsigned short lens;        /**< XOR of lengths of recieved data and parity */
+    unsigned short flags;       /**< XOR of data flags of recieved data and parity */
+    unsigned short len;         /**< length of data which can be non-zero */
+    unsigned short parity;      /**< number of packets protected by recieved parity, 0 whether has not come */
+} TFecBlock;
+
+/**
+ * FEC decoder structure - ring of blocks covering receiving window.
+ */
+typedef struct {
+    TFecBlock *blocks;          /**< ring of blocks, NULL whether nothing was recieved */
+    unsigned int count;         /**< number of blocks */
+    unsigned int block_size;    /**< number of data packets protected by one parity, 0 disables FEC */
+    unsigned int slot_size;     /**< max data length of one packet */
+} TFec;
+
+/**
+ * Initializes decoder, storage is allocated with first data.
+ * @param fec Pointer to decoder.
+ * @param block_size Number of data packets protected by one parity, 0 disables FEC.
+ * @param window Number of packets which can be in flight.
+ * @param slot_size Max data length of one packet.
+ */
+void initFec(TFec *fec, unsigned int block_size, unsigned int window, unsigned int slot_size);
+
+/**
+ * Adds recieved data packet into its block, every packet has to be added once.
+ * @param fec Pointer to decoder.
+ * @param seq_num Sequence number of data.
+ * @param data Pointer to data.
+ * @param len Length of data.
+ * @param flags Data flags of packet - LZ.
+ */
+void fecAdd(TFec *fec, unsigned int seq_num, char *data, unsigned short len, unsigned short flags);
+
+/**
+ * Adds recieved parity into its block.
+ * @param fec Pointer to decoder.
+ * @param packet Decoded parity packet.
+ * @return Returns 1 on success or 0 whether is parity invalid, repeated or too old.
+ */
+int fecParity(TFec *fec, RDTPacket *packet);
+
+/**
+ * Rebuilds the only lost packet of block whether its parity came.
+ * @param fec Pointer to decoder.
+ * @param buffer Buffer of recieved data - tells which packet is lost.
+ * @param seq_num Any sequence number of block.
+ * @param packet Pointer where will be stored rebuilt packet, its data point into block.
+ * @return Returns 1 whether was packet rebuilt else 0.
+ */
+int fecRepair(TFec *fec, TBuffer *buffer, unsigned int seq_num, RDTPacket *packet);
+
+/**
+ * Destroyes decoder - releases its storage, decoder can be used again.
+ * @param fec Pointer to decoder.
+ */
+void destroyFec(TFec *fec);
+
+#endif /* FEC_H_ */
+
+/*** End of file fec.h ***/
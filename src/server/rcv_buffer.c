@@ -18,81 +18,223 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include "rcv_buffer.h"
 
+#define BUFFER_IOV 1024        // Max number of slots printed by one write
+
+/**
+ * Tests presence bit of slot.
+ */
+#define PRESENT(buffer, offset) ((buffer)->present[(offset) >> 6] & (1ULL << ((offset) & 63)))
+
+/**
+ * Data lengths of chunk slots, they are stored at the chunk start.
+ */
+#define CHUNK_LENS(chunk) ((unsigned short *)(chunk))
+
+/**
+ * Size of data lengths at the chunk start, slots are aligned behind.
+ */
+#define CHUNK_HEADER ((BUFFER_CHUNK * sizeof(unsigned short) + 63) & ~(size_t)63)
+
+/**
+ * Returns pointer to slot of the specified offset, its chunk has to be allocated.
+ * @param buffer Pointer to buffer.
+ * @param offset Offset of slot.
+ * @return Returns pointer to slot.
+ */
+static inline char *slotData(TBuffer *buffer, unsigned int offset) {
+    return buffer->chunks[offset / BUFFER_CHUNK] + CHUNK_HEADER +
+           (size_t)(offset % BUFFER_CHUNK) * buffer->slot_size;
+}
+
 /**
- * Initializes buffer.
+ * Initializes empty buffer, storage is allocated with first data.
  * @param buffer Pointer to buffer.
+ * @param size Number of slots, rounded up to power of 2, at most BUFFERMAX.
+ * @param slot_size Max data length of one slot.
+ * @param fd Descriptor where are data printed.
  */
-void initBuffer(TBuffer *buffer) {
-    for (int i = 0; i < BUFFERSIZE; i++) {
-        buffer->data[i] = NULL;
+void initBuffer(TBuffer *buffer, unsigned int size, unsigned int slot_size, int fd) {
+    unsigned int capacity = BUFFER_CHUNK;   // At least one chunk
+    
+    if (size > BUFFERMAX) {
+        size = BUFFERMAX;
     }
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+
+    buffer->chunks = NULL;
+    buffer->present = NULL;
+    buffer->size = capacity;
+    buffer->mask = capacity - 1;
+    buffer->slot_size = slot_size;
     buffer->first_seq = 0;
+    buffer->next_seq = 0;
     buffer->last_seq = 0;
+    buffer->fd = fd;
+}
+
+/**
+ * Allocates chunk table and bitmap of empty buffer.
+ * @param buffer Pointer to buffer.
+ * @return Returns 1 on success or 0 on memory allocation fail.
+ */
+static int allocBuffer(TBuffer *buffer) {
+    buffer->chunks = calloc(buffer->size / BUFFER_CHUNK, sizeof(char *));
+    buffer->present = calloc(buffer->size / 64, sizeof(uint64_t));
+    if (buffer->chunks == NULL || buffer->present == NULL) {
+        destroyBuffer(buffer);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Writes whole vector of data, repeats on partial write.
+ * @param fd Output descriptor.
+ * @param iov Vector of data.
+ * @param cnt Number of items in vector.
+ * @return Returns 1 on success or 0 on write fail.
+ */
+static int writeAll(int fd, struct iovec *iov, int cnt) {
+    while (cnt > 0) {
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return 0;
+        }
+        // Skip written items
+        while (cnt > 0 && (size_t)n >= iov->iov_len) {
+            n -= iov->iov_len;
+            iov++;
+            cnt--;
+        }
+        if (cnt > 0) {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return 1;
 }
 
 /**
- * Prints data from buffer on STDOUT whether it is possible.
+ * Prints in-order buffered data in one bulk write. Printed chunks are
+ * released, whole storage is released whether is buffer empty.
  * @param buffer Pointer to buffer.
+ * @return Returns 1 on success or 0 on write fail.
  */
-void printBuffer(TBuffer *buffer) {
-    // For each buffered data
-    while (buffer->first_seq <= buffer->last_seq) {
-        unsigned int seq = (buffer->first_seq) % BUFFERSIZE;
-        // Print only buffered data in correct order
-        if (buffer->data[seq] != NULL) {
-            fputs(buffer->data[seq], stdout);
-            free(buffer->data[seq]);
-            buffer->data[seq] = NULL;
+int flushBuffer(TBuffer *buffer) {
+    struct iovec iov[BUFFER_IOV];
+    
+    fflush(stdout);   // Keep order with data printed through stdio
+    
+    // For each buffered data in correct order
+    while (buffer->first_seq != buffer->next_seq) {
+        unsigned int start = buffer->first_seq;
+        int cnt = 0;
+        while (buffer->first_seq != buffer->next_seq && cnt < BUFFER_IOV) {
+            unsigned int offset = buffer->first_seq & buffer->mask;
+            iov[cnt].iov_base = slotData(buffer, offset);
+            iov[cnt].iov_len = CHUNK_LENS(buffer->chunks[offset / BUFFER_CHUNK])[offset % BUFFER_CHUNK];
+            buffer->present[offset >> 6] &= ~(1ULL << (offset & 63));
             buffer->first_seq++;
-        } else { // There was blank space - cannot be buffered
-            break;
+            cnt++;
+        }
+        if (!writeAll(buffer->fd, iov, cnt)) {
+            return 0;
+        }
+        
+        // Release printed chunks, chunk holds next ring round too - its slots have to be empty
+        for (unsigned int seq = start & ~(BUFFER_CHUNK - 1); seq + BUFFER_CHUNK <= buffer->first_seq; seq += BUFFER_CHUNK) {
+            unsigned int chunk = (seq & buffer->mask) / BUFFER_CHUNK;
+            if (buffer->present[chunk] == 0) {   // Chunk is one bitmap word
+                free(buffer->chunks[chunk]);
+                buffer->chunks[chunk] = NULL;
+            }
         }
     }
+    
+    // Nothing waits - buffer costs no memory
+    if (buffer->present != NULL && buffer->last_seq < buffer->next_seq) {
+        destroyBuffer(buffer);
+    }
+    return 1;
 }
 
 /**
- * Stores data to STDOUT buffer.
+ * Stores copy of data to buffer.
  * @param buffer Pointer to buffer.
  * @param seq_num Sequence number of data.
  * @param data Pointer to data to be stored.
- * @return Return the same data on success or NULL on fail.    
+ * @param len Length of data, at most slot_size.
+ * @return Return pointer to buffered data on success or NULL on fail.    
  */
-char *toBuffer(TBuffer *buffer, unsigned int seq_num, char *data) {
+char *toBuffer(TBuffer *buffer, unsigned int seq_num, char *data, unsigned short len) {
 
-    unsigned int offset = seq_num % BUFFERSIZE;
+    unsigned int offset = seq_num & buffer->mask;
     
-    // Check for ranges and empty place
-    if ((buffer->first_seq <= seq_num) && 
-        (seq_num < buffer->first_seq + BUFFERSIZE) &&
-        (buffer->data[offset] == NULL)) {
-        
-        // Setting new last buffered sequence
-        if (buffer->last_seq < seq_num) {
-            buffer->last_seq = seq_num;
-        }
-        
-        buffer->data[offset] = data;
-        printBuffer(buffer);          // Try to print buffer
+    // Check for ranges
+    if ((buffer->first_seq > seq_num) || 
+        (seq_num >= buffer->first_seq + buffer->size) ||
+        (len > buffer->slot_size)) {
+        return NULL;
+    }
+    
+    // Storage is allocated on demand
+    if (buffer->present == NULL && !allocBuffer(buffer)) {
+        return NULL;
+    }
+    char **chunk = &buffer->chunks[offset / BUFFER_CHUNK];
+    if (*chunk == NULL &&
+        (*chunk = malloc(CHUNK_HEADER + (size_t)BUFFER_CHUNK * buffer->slot_size)) == NULL) {
+        return NULL;
+    }
+    
+    // Check for empty place
+    if (PRESENT(buffer, offset)) {
+        return NULL;
+    }
         
-        return buffer->data[offset];
+    // Setting new last buffered sequence
+    if (buffer->last_seq < seq_num) {
+        buffer->last_seq = seq_num;
     }
     
-    return NULL;
+    char *slot = slotData(buffer, offset);
+    memcpy(slot, data, len);
+    CHUNK_LENS(*chunk)[offset % BUFFER_CHUNK] = len;
+    buffer->present[offset >> 6] |= 1ULL << (offset & 63);
+    
+    // Move first unbuffered sequence behind continuous data
+    while (buffer->next_seq - buffer->first_seq < buffer->size &&
+           PRESENT(buffer, buffer->next_seq & buffer->mask)) {
+        buffer->next_seq++;
+    }
+    
+    return slot;
 } 
 
 /**
- * Destroyes buffer.    
+ * Destroyes buffer - releases its storage, buffer can be used again.
+ * @param buffer Pointer to buffer.
  */
 void destroyBuffer(TBuffer *buffer) {
-    for (int i = 0; i < BUFFERSIZE; i++) {
-        if (buffer->data[i] != NULL) {
-            free(buffer->data[i]);
-            buffer->data[i] = NULL;
+    if (buffer->chunks != NULL) {
+        for (unsigned int i = 0; i < buffer->size / BUFFER_CHUNK; i++) {
+            free(buffer->chunks[i]);
         }
     }
+    free(buffer->chunks);
+    free(buffer->present);
+    buffer->chunks = NULL;
+    buffer->present = NULL;
 }
 
 /**
@@ -102,21 +244,65 @@ void destroyBuffer(TBuffer *buffer) {
  * @return Returns 1 whether are data buffered else returns 0s.    
  */
 int isBuffered(TBuffer *buffer, unsigned int seq_num) {
-    if ((seq_num < buffer->first_seq) || // already printed 
+    if ((seq_num < buffer->next_seq) || // already printed or waiting for print
     // Not printed, but buffered
-    ((seq_num <= buffer->last_seq) && (buffer->data[seq_num % BUFFERSIZE] != NULL))) {
+    ((buffer->present != NULL) && (seq_num <= buffer->last_seq) &&
+     (seq_num < buffer->first_seq + buffer->size) &&
+     PRESENT(buffer, seq_num & buffer->mask))) {
         return 1;
     }
     return 0;   
 }
 
+/**
+ * Finds ranges of data buffered behind first unbuffered sequence.
+ * Bitmap is searched by whole words, so empty space is skipped quickly.
+ * @param buffer Pointer to buffer.
+ * @param blocks Array where will be stored first and behind last sequence of each range.
+ * @param max Max number of ranges.
+ * @return Returns number of found ranges.    
+ */
+int bufferedBlocks(TBuffer *buffer, unsigned int *blocks, int max) {
+    unsigned int seq = buffer->next_seq;
+    int cnt = 0;
+    
+    if (buffer->present == NULL) {   // Nothing is buffered
+        return 0;
+    }
+    while (cnt < max && seq <= buffer->last_seq) {
+        // Skip blank sequences
+        unsigned int offset = seq & buffer->mask;
+        uint64_t word = buffer->present[offset >> 6] >> (offset & 63);
+        if (word == 0) {
+            seq += 64 - (offset & 63);
+            continue;
+        }
+        seq += __builtin_ctzll(word);
+        if (seq > buffer->last_seq) break;
+        
+        // Find end of buffered range
+        blocks[2 * cnt] = seq;
+        do {
+            offset = seq & buffer->mask;
+            word = ~buffer->present[offset >> 6] >> (offset & 63);
+            seq += word ? (unsigned int)__builtin_ctzll(word) : 64 - (offset & 63);
+        } while (!word && seq <= buffer->last_seq);
+        if (seq > buffer->last_seq + 1) {
+            seq = buffer->last_seq + 1;
+        }
+        blocks[2 * cnt + 1] = seq;
+        cnt++;
+    }
+    return cnt;
+}
+
 /**
  * Finds first demanded sequence number of data which has not been buffered.
  * @param buffer Pointer to buffer.
  * @return Returns sequence number of first unbuffered data.    
  */
 unsigned int firstBlank(TBuffer *buffer) {
-    return buffer->first_seq;   
+    return buffer->next_seq;   
 }
 
 /*** End of file rcv_buffer.c ***/
@@ -16,34 +16,61 @@
 * @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
 */
 
-#define BUFFERSIZE 16          // Size of STDOUT buffer
+#ifndef RCV_BUFFER_H_
+#define RCV_BUFFER_H_
+
+#include <stdint.h>
+
+#define BUFFERSIZE 32768       // Default number of STDOUT buffer slots
+#define BUFFERMAX  (1 << 20)   // Max number of STDOUT buffer slots
+#define BUFFER_CHUNK 64        // Number of slots allocated at once - one bitmap word
 
 /**
- * STDOUT print buffer structure.
+ * Reorder buffer structure - ring of fixed-size slots with presence bitmap.
+ * Storage is allocated by chunks of slots on demand and released whether
+ * are chunks printed, so idle buffer takes just this structure.
  */
 typedef struct {
-    char *data[BUFFERSIZE];     /**< data buffers */
-    unsigned int first_seq;     /**< first unbufered sequence */
+    char **chunks;              /**< slot chunks - data lengths followed by slots, NULL whether unused */
+    uint64_t *present;          /**< presence bitmap of slots, NULL whether is buffer empty */
+    unsigned int size;          /**< number of slots, power of 2 */
+    unsigned int mask;          /**< size - 1 */
+    unsigned int slot_size;     /**< max data length of one slot */
+    unsigned int first_seq;     /**< first unprinted sequence */
+    unsigned int next_seq;      /**< first unbuffered sequence */
     unsigned int last_seq;      /**< last buffered sequence */
+    int fd;                     /**< descriptor where are data printed */
 } TBuffer;
 
 /**
- * Initializes buffer.
+ * Initializes empty buffer, storage is allocated with first data.
  * @param buffer Pointer to buffer.
+ * @param size Number of slots, rounded up to power of 2, at most BUFFERMAX.
+ * @param slot_size Max data length of one slot.
+ * @param fd Descriptor where are data printed.
  */
-void initBuffer(TBuffer *buffer);
+void initBuffer(TBuffer *buffer, unsigned int size, unsigned int slot_size, int fd);
 
 /**
- * Stores data to STDOUT buffer.
+ * Stores copy of data to buffer.
  * @param buffer Pointer to buffer.
  * @param seq_num Sequence number of data.
  * @param data Pointer to data to be stored.
- * @return Return the same data on success or NULL on fail.    
+ * @param len Length of data, at most slot_size.
+ * @return Return pointer to buffered data on success or NULL on fail.    
+ */
+char *toBuffer(TBuffer *buffer, unsigned int seq_num, char *data, unsigned short len);
+
+/**
+ * Prints in-order buffered data in one bulk write.
+ * @param buffer Pointer to buffer.
+ * @return Returns 1 on success or 0 on write fail.
  */
-char *toBuffer(TBuffer *buffer, unsigned int seq_num, char *data);
+int flushBuffer(TBuffer *buffer);
 
 /**
- * Destroyes buffer.    
+ * Destroyes buffer - releases its storage, buffer can be used again.
+ * @param buffer Pointer to buffer.
  */
 void destroyBuffer(TBuffer *buffer);
 
@@ -54,6 +81,15 @@ void destroyBuffer(TBuffer *buffer);
  */
 unsigned int firstBlank(TBuffer *buffer);
 
+/**
+ * Finds ranges of data buffered behind first unbuffered sequence.
+ * @param buffer Pointer to buffer.
+ * @param blocks Array where will be stored first and behind last sequence of each range.
+ * @param max Max number of ranges.
+ * @return Returns number of found ranges.    
+ */
+int bufferedBlocks(TBuffer *buffer, unsigned int *blocks, int max);
+
 /**
  * Checks whether is demanded sequence of data already buffered.
  * @param buffer Pointer to buffer.
@@ -62,4 +98,6 @@ unsigned int firstBlank(TBuffer *buffer);
  */
 int isBuffered(TBuffer *buffer, unsigned int seq_num);
 
+#endif /* RCV_BUFFER_H_ */
+
 /*** End of file rcv_buffer.h ***/
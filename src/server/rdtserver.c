@@ -6,42 +6,58 @@
 * Lasta modified:   20.4.2011
 * Author:           Radim Loskot xlosko01(at)stud.fit.vutbr.cz
 *
-* Brief: RDT server using sliding stdout print buffer and GO-BACK-N 
-*        as acknowledgement algorithm.
+* Brief: RDT server using sliding stdout print buffer, Go-Back-N or
+*        Selective Repeat is chosen by client for each connection.
 *
 *******************************************************************/
 /**
 * @file rdtserver.c
 *
-* @brief RDT server using sliding stdout print buffer and GO-BACK-N 
-* @brief as acknowledgement algorithm.
+* @brief RDT server using sliding stdout print buffer, Go-Back-N or
+* @brief Selective Repeat is chosen by client for each connection.
 * @author Radim Loskot xlosko01(at)stud.fit.vutbr.cz
 */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
-#define _GNU_SOURCE
 #include <getopt.h>
 #include <string.h>
 #include <fcntl.h>
 #include <stdarg.h>
 #include "../libs/udt.h"
 #include "../libs/rdt.h"
+#include "../libs/evloop.h"
+#include "../libs/lz.h"
 #include "rcv_buffer.h"
+#include "conn_table.h"
 #include <sys/time.h>
-#include <signal.h>
 #include <arpa/inet.h>
 #include <limits.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <pthread.h>
+#include <sched.h>
 
-// Max recieving packet size 
-#define RCV_PACKETSIZE 100
+// Recieving buffer size - max packet or packets coalesced by receive offload
+#define RCV_PACKETSIZE UDT_GRO_SIZE
+
+// Number of in-order packets acknowledged at once by delayed ACK
+#define ACKEVERY   4
+// Max delay of ACK in ms
+#define ACKDELAY   10
+// Max number of worker threads
+#define WORKERMAX  64
+// Time in ms for which is closed connection kept to answer repeated FIN
+#define FINWAIT    2000
+// Time in ms without packets after which is open connection considered as dead - several RTO_MAX of client
+#define IDLEWAIT   300000
+// Period in ms of checking idle connections
+#define IDLECHECK  10000
 
-in_addr_t dest_addr = 0x7f000001;    /**< destination address - only localhost */
 in_port_t src_port = 4040;              /**< local incomming port */
-in_port_t dest_port = 4030;             /**< destination port - where to send */
-int udt;                             /**< socket descriptor */
-#define PACKETSIZE 22                /**< Out-coming packet size */
+__thread int udt;                    /**< socket descriptor of worker */
 
 /**
  * Enum of all handled errors.
@@ -49,7 +65,14 @@ int udt;                             /**< socket descriptor */
 enum errors {
     E_MALLOC,       /**< enum Memory allocation error. */
     E_UDTSEND,      /**< enum Some error caused fail of sending current packet. */
-    E_BADPARAMS     /**< enum Bad run parameters from cmd-line. */
+    E_BADPARAMS,    /**< enum Bad run parameters from cmd-line. */
+    E_BUFFERSIZE,   /**< enum Buffer size out of range. */
+    E_DATASIZE,     /**< enum Data size out of range. */
+    E_WRITE,        /**< enum Writing on STDOUT failed. */
+    E_EVLOOP,       /**< enum Event loop failed. */
+    E_OPEN,         /**< enum Output file of connection cannot be opened. */
+    E_WORKERS,      /**< enum Number of workers out of range. */
+    E_THREAD        /**< enum Worker thread cannot be started. */
 };
 
 /**
@@ -58,7 +81,14 @@ enum errors {
 const char* ERRORS[] = {
     "Error: Memory allocation failed!\n",             // E_MALLOC
     "Error: Unable send packet.\n",                   // E_UDTSEND
-    "Error: Missing source or destination port!\n"    // E_BADPARAMS
+    "Error: Missing source port!\n",                  // E_BADPARAMS
+    "Error: Buffer size must be 1 - 1048576!\n",       // E_BUFFERSIZE
+    "Error: Data size must be 1 - 65491!\n",           // E_DATASIZE
+    "Error: Unable write data on STDOUT.\n",           // E_WRITE
+    "Error: Event loop failed.\n",                     // E_EVLOOP
+    "Error: Unable open output file of connection.\n", // E_OPEN
+    "Error: Number of workers must be 1 - 64!\n",      // E_WORKERS
+    "Error: Unable start worker thread.\n"             // E_THREAD
 };
 
 /**
@@ -66,7 +96,9 @@ const char* ERRORS[] = {
  */
 enum msgs {
     MSG_MANYPARAMS,   /**< enum Many run params specified. */
-    MSG_USAGE         /**< enum Usage message. */
+    MSG_USAGE,        /**< enum Usage message. */
+    MSG_NOGRO,        /**< enum Receive offload unsupported. */
+    MSG_NOSTEER       /**< enum Steering by connection ID unsupported. */
 };
 
 /**
@@ -74,13 +106,55 @@ enum msgs {
  */
 const char *MSGS[] = {
     "Warning: Too many options/arguments!\n",             // MSG_MANYPARAMS
-    "Usage: rdtclient -s source_port -d dest_port\n"      // MSG_USAGE
+    "Usage: rdtserver [-s source_port] [-b buffer_size] [-p data_size] [-a ack_every]\n                 [-t ack_delay] [-g] [-o output_dir] [-n workers] [-c]\n"
+    "Without -o one transfer is printed on STDOUT and server exits after it.\n",      // MSG_USAGE
+    "Warning: Receive offload is not supported!\n",    // MSG_NOGRO
+    "Warning: Steering by connection is not supported, flows are spread by kernel!\n" // MSG_NOSTEER
 };
 
 
-char PACKET_BUFFER[PACKETSIZE];     /**< Packet buffer for preparing packets */
-                                    
-TBuffer output_buff;                /**< STDOUT print buffer */
+/**
+ * Worker - thread with own socket, loop and connections.
+ */
+typedef struct {
+    pthread_t thread;                /**< thread of worker */
+    int udt;                         /**< socket descriptor sharing port */
+    int cpu;                         /**< CPU where is worker pinned, -1 whether is not */
+} TWorker;
+
+// State of worker - every thread has its own, packet path is not locked
+__thread char PACKET_BUFFER[UDT_BATCH][ACK_PACKETSIZE] __attribute__((aligned(PACKET_ALIGN))); /**< Packet buffers for preparing ACK/NACK packets */
+__thread udt_datagram out_dgrams[UDT_BATCH];  /**< ACK/NACK packets waiting for batch send */
+__thread TConnTable conns;           /**< table of connections of worker */
+__thread TConn *ack_list = NULL;     /**< connections waiting for delayed ACK */
+__thread TConn *dirty_list = NULL;   /**< connections with data recieved by current batch */
+__thread TEvLoop loop;               /**< event loop */
+__thread int ack_timer;              /**< delayed ACK timer descriptor */
+__thread int wait_timer;             /**< timer descriptor removing closed connections */
+__thread TConn *wait_first = NULL;   /**< closed connections ordered by removal time */
+__thread TConn *wait_last = NULL;    /**< the last closed connection */
+__thread TConn *idle_first = NULL;   /**< open connections ordered by last_active */
+__thread TConn *idle_last = NULL;    /**< the last active open connection */
+__thread int64_t idle_check = 0;     /**< time in us of the next check of idle connections */
+__thread int64_t batch_now = 0;      /**< time in us when current batch was recieved */
+__thread char *recv_packets;         /**< recieving packet buffers - UDT_BATCH packets */
+__thread char LZ_BUFFER[MAX_DATASIZE]; /**< decompressed data of packet */
+__thread char ALIGN_BUFFER[MAX_PACKETSIZE] __attribute__((aligned(PACKET_ALIGN))); /**< copy of coalesced packet at unaligned offset */
+__thread unsigned int out_count = 0; /**< number of packets waiting for batch send */
+
+// Shared by workers
+TWorker *workers;                    /**< workers */
+unsigned int worker_count = 1;       /**< number of workers */
+int pin_cpu = 0;                     /**< is set to 1 whether are workers pinned to CPUs */
+int stop_fd = -1;                    /**< event stopping all workers */
+unsigned int active = 0;             /**< number of connections of all workers including closed ones - atomic */
+int stdout_taken = 0;                /**< is set to 1 whether a connection prints on STDOUT - atomic */
+char *out_dir = NULL;                /**< directory for output files of connections, NULL prints on STDOUT */
+unsigned int buffer_size = BUFFERSIZE; /**< number of buffer slots of connection */
+unsigned int data_size = MAX_DATASIZE; /**< max accepted length of data inside one packet, at least MIN_DATASIZE is accepted */
+unsigned int ack_every = ACKEVERY;   /**< number of packets acknowledged by delayed ACK */
+unsigned int ack_delay = ACKDELAY;   /**< max delay of ACK in ms */
+int gro = 0;                         /**< is set to 1 whether is receive offload requested */
 
 /**
  * Prints error.
@@ -89,84 +163,616 @@ TBuffer output_buff;                /**< STDOUT print buffer */
 void printError(int error) {
     fprintf(stderr, "%s", ERRORS[error]);
     perror("Caused: ");
-	destroyBuffer(&output_buff);
+	destroyTable(&conns);
     exit(1);
 }
 
 /**
- * Sends acknowledgement to sequence.
- * @param seq Sequence number to acknowledge. 
+ * Sends all waiting ACK/NACK packets by one batch, packets not accepted
+ * by full socket buffer are lost.
+ */
+void flushStatus() {
+    int sent = out_count ? udt_send_batch(udt, out_dgrams, out_count) : 0;
+    out_count = 0;
+    if (sent < 0) {
+		printError(E_UDTSEND);
+    }
+}
+
+/**
+ * Takes buffer for ACK/NACK packet, packet waits for batch send until
+ * flushStatus is called or the batch is full.
+ * @return Returns packet buffer.
+ */
+char *statusBuffer() {
+    // Queue is full - free packet buffers
+    if (out_count == UDT_BATCH) {
+        flushStatus();
+    }
+    return PACKET_BUFFER[out_count];
+}
+
+/**
+ * Encodes packet into buffer taken by statusBuffer and queues it for sending.
+ * @param packet Packet structure.
+ * @param buffer Buffer taken by statusBuffer.
+ * @param addr Address of client.
+ * @param port Port of client.
+ */
+void queuePacket(RDTPacket packet, char *buffer, in_addr_t addr, in_port_t port) {
+    encodePacket(packet, buffer);
+    out_dgrams[out_count].buff = buffer;
+    out_dgrams[out_count].nbytes = packetLen(buffer);
+    out_dgrams[out_count].addr = addr;
+    out_dgrams[out_count].port = port;
+    out_count++;
+}
+
+/**
+ * Encodes packet into buffer taken by statusBuffer and queues it for sending
+ * to the source of the last packet of connection.
+ * @param conn Connection. 
+ * @param packet Packet structure.
+ * @param buffer Buffer taken by statusBuffer.
+ */
+void queueStatus(TConn *conn, RDTPacket packet, char *buffer) {
+    queuePacket(packet, buffer, conn->addr, conn->port);
+}
+
+/**
+ * Answers packet of connection which is not inside table - SYN with NACK
+ * asks client for SYN, RST refuses its SYN.
+ * @param view Decoded recieved packet.
+ * @param flags Flags of answer.
+ * @param addr Address of client.
+ * @param port Port of client.
  */
-void sendACK(unsigned int seq) {
-    // Praparing packet to send
+void sendReject(RDTPacket *view, unsigned short flags, in_addr_t addr, in_port_t port) {
+    char *_packet = statusBuffer();
     RDTPacket packet;
-    packet.seq = seq;
+    packet.seq = view->seq;
+    packet.conn = view->conn;
     packet.len = 0;
-    packet.flags = ACK;
     packet.data = NULL;
+    packet.flags = flags | (view->flags & CRC);
+    queuePacket(packet, _packet, addr, port);
+}
 
-    // Making final packet from packet structure
-    char *_packet = makePacket(packet);
-    if(_packet == NULL) {
-		printError(E_MALLOC);
-    }
+/**
+ * Sends ACK or NACK packet, out-of-order buffered data are reported by
+ * SACK blocks whether client understands them.
+ * @param conn Connection. 
+ * @param seq Sequence number of packet. 
+ * @param flags Flags of packet - ACK or NACK.
+ */
+void sendStatus(TConn *conn, unsigned int seq, unsigned short flags) {
+    unsigned int blocks[2 * SACK_BLOCKS];
+    int cnt = (conn->features & FEAT_SACK) ? bufferedBlocks(&conn->buff, blocks, SACK_BLOCKS) : 0;
+    char *_packet = statusBuffer();
     
-    // Sending packet
-	if (!udt_send(udt, dest_addr, dest_port, _packet, packetLen(_packet))) {
-		printError(E_UDTSEND);
-	}
+    // Praparing packet to send, SACK blocks are coded in place
+    RDTPacket packet;
+    packet.seq = seq;
+    packet.conn = conn->id;
+    packet.len = sackData(blocks, cnt, &_packet[DATA_OFFSET]);
+    packet.flags = (cnt ? flags | SACK : flags) | conn->sum_flag;
+    packet.data = &_packet[DATA_OFFSET];
+    queueStatus(conn, packet, _packet);
+}
 
-    free(_packet);
+/**
+ * Answers SYN by accepted parameters of connection, answer acknowledges
+ * data of the first flight as well.
+ * @param conn Connection. 
+ */
+void sendSynAck(TConn *conn) {
+    char *_packet = statusBuffer();
+    RDTParams params;
+    params.window = conn->buff.size < buffer_size ? conn->buff.size : buffer_size;
+    params.data_size = conn->buff.slot_size;
+    params.features = conn->features;
+    params.fec_block = conn->fec.block_size;
+    
+    RDTPacket packet;
+    packet.seq = firstBlank(&conn->buff);
+    packet.conn = conn->id;
+    packet.len = synData(&params, &_packet[DATA_OFFSET]);
+    packet.flags = SYN | ACK | conn->sum_flag;
+    packet.data = &_packet[DATA_OFFSET];
+    queueStatus(conn, packet, _packet);
+    conn->ack_pending = 0;
+}
+
+/**
+ * Sends cumulative acknowledgement - all sequences before are recieved.
+ * @param conn Connection. 
+ * @param seq First sequence number which is not acknowledged. 
+ */
+void sendACK(TConn *conn, unsigned int seq) {
+    sendStatus(conn, seq, ACK);
+    conn->ack_pending = 0;
 }
 
 /**
  * Sends non-acknowledgement to sequence.
+ * @param conn Connection. 
  * @param seq Sequence number to not acknowledge. 
  */
-void sendNACK(unsigned int seq) {
-    // Praparing packet to send
+void sendNACK(TConn *conn, unsigned int seq) {
+    sendStatus(conn, seq, NACK);
+}
+
+/**
+ * Stops all workers.
+ */
+void stopWorkers() {
+    uint64_t one = 1;
+    if (write(stop_fd, &one, sizeof(one)) != sizeof(one)) {
+        printError(E_EVLOOP);
+    }
+}
+
+/**
+ * Stop event handler - stops loop of worker, event stays signaled for others.
+ * @param fd Event descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void stopWorker(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    ev_stop(&loop);
+}
+
+/**
+ * Answers FIN - all data of connection were printed.
+ * @param conn Connection. 
+ */
+void sendFinAck(TConn *conn) {
+    char *_packet = statusBuffer();
     RDTPacket packet;
-    packet.seq = seq;
+    packet.seq = conn->fin_seq;
+    packet.conn = conn->id;
     packet.len = 0;
-    packet.flags = NACK;
     packet.data = NULL;
+    packet.flags = FIN | ACK | conn->sum_flag;
+    queueStatus(conn, packet, _packet);
+}
 
-    // Making final packet from packet structure
-    char *_packet = makePacket(packet);
-    if(_packet == NULL) {
-		printError(E_MALLOC);
+/**
+ * Marks activity of open connection, it is moved to the end of idle list.
+ * @param conn Connection.
+ * @param now Time of activity in us.
+ */
+void touchConn(TConn *conn, int64_t now) {
+    conn->last_active = now;
+    if (idle_last == conn) {
+        return;
+    }
+    if (conn->prev_idle != NULL) {   // Unlink whether is already inside
+        conn->prev_idle->next_idle = conn->next_idle;
+    } else if (idle_first == conn) {
+        idle_first = conn->next_idle;
+    }
+    if (conn->next_idle != NULL) {
+        conn->next_idle->prev_idle = conn->prev_idle;
+    }
+    conn->next_idle = NULL;
+    conn->prev_idle = idle_last;
+    if (idle_last != NULL) {
+        idle_last->next_idle = conn;
+    } else {
+        idle_first = conn;
     }
+    idle_last = conn;
+}
 
-    // Sending packet
-	if (!udt_send(udt, dest_addr, dest_port, _packet, packetLen(_packet))) {
-		printError(E_UDTSEND);
-	}
+/**
+ * Creates connection with parameters proposed by client limited by server
+ * ones, its output file is opened with first printed data.
+ * @param id Connection ID.
+ * @param params Parameters proposed by client SYN.
+ * @return Returns new connection.
+ */
+TConn *openConn(unsigned int id, RDTParams *params) {
+    TConn *conn = addConn(&conns, id);
+    if (conn == NULL) {
+        printError(E_MALLOC);
+    }
+    // Packets sent before answer have MIN_DATASIZE, they are accepted always
+    unsigned int size = data_size < MIN_DATASIZE ? MIN_DATASIZE : data_size;
+    unsigned int window = params->window < buffer_size ? params->window : buffer_size;
+    initBuffer(&conn->buff, window,
+               params->data_size < size ? params->data_size : size,
+               out_dir ? -1 : STDOUT_FILENO);
+    conn->features = params->features & (FEAT_SACK | FEAT_CRC | FEAT_SR | FEAT_LZ);
+    // Parity can rebuild only packets which would be buffered out of order
+    initFec(&conn->fec, (conn->features & FEAT_SR) && params->fec_block <= FEC_BLOCKMAX ? params->fec_block : 0,
+            conn->buff.size, conn->buff.slot_size);
+    // Small window would wait for ACK timer each round
+    conn->ack_every = window / 2 < ack_every ? window / 2 : ack_every;
+    if (conn->ack_every == 0) conn->ack_every = 1;
+    touchConn(conn, ev_now());
+    __atomic_add_fetch(&active, 1, __ATOMIC_RELAXED);
+    return conn;
+}
 
-    free(_packet);
+/**
+ * Prints in-order buffered data of connection, output file is opened
+ * whether is needed.
+ * @param conn Connection.
+ */
+void flushConn(TConn *conn) {
+    if (conn->buff.fd == -1 && conn->buff.first_seq != conn->buff.next_seq) {
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%08x", out_dir, conn->id);
+        if ((conn->buff.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644)) == -1) {
+            printError(E_OPEN);
+        }
+    }
+    if (!flushBuffer(&conn->buff)) {
+        printError(E_WRITE);
+    }
 }
 
 /**
- * Buffering packet to STDOUT buffer.
- * @param packet Packet to store into buffer. 
+ * Closes connection - its output file and buffer. Connection stays in table
+ * for FINWAIT ms to answer repeated FIN whether was the answer lost.
+ * @param conn Connection.
  */
-void buffData(char *packet) {
-    unsigned int seq = seqNumber(packet);
+void closeConn(TConn *conn) {
+    if (conn->flags & CONN_ACK) {   // Unlink from delayed ACK list
+        TConn **link = &ack_list;
+        while (*link != conn) {
+            link = &(*link)->next_ack;
+        }
+        *link = conn->next_ack;
+    }
+    if (conn->buff.fd != -1 && conn->buff.fd != STDOUT_FILENO) {
+        close(conn->buff.fd);
+    }
+    // Unlink from idle list
+    if (conn->prev_idle != NULL) {
+        conn->prev_idle->next_idle = conn->next_idle;
+    } else {
+        idle_first = conn->next_idle;
+    }
+    if (conn->next_idle != NULL) {
+        conn->next_idle->prev_idle = conn->prev_idle;
+    } else {
+        idle_last = conn->prev_idle;
+    }
+    conn->buff.fd = -1;
+    destroyBuffer(&conn->buff);
+    destroyFec(&conn->fec);
+    conn->flags = CONN_WAIT;
     
-    if (!isBuffered(&output_buff, seq)) { // Buffer data only whether are not already buffered
-        // Allocate mamory for data buffer
-        char *data = malloc((dataLen(packet) + 1) * sizeof(char));
-        if(data == NULL) {
-            printError(E_MALLOC);
+    // All connections wait the same time - appending keeps order
+    conn->expires = ev_now() + FINWAIT * 1000;
+    conn->next_wait = NULL;
+    if (wait_last != NULL) {
+        wait_last->next_wait = conn;
+    } else {
+        wait_first = conn;
+        ev_timer_arm(wait_timer, FINWAIT * 1000);
+    }
+    wait_last = conn;
+}
+
+/**
+ * Closes open connections which recieved no packet for IDLEWAIT ms - client
+ * is dead, its data out of order are dropped and later packets are answered
+ * as of unknown connection.
+ * @param now Current time in us.
+ */
+void closeIdle(int64_t now) {
+    // The least active connections are at the beginning
+    while (idle_first != NULL && now - idle_first->last_active > IDLEWAIT * 1000) {
+        TConn *conn = idle_first;
+        closeConn(conn);
+        conn->flags |= CONN_IDLE;
+    }
+}
+
+/**
+ * Timer handler - removes closed connections after FINWAIT and closes idle
+ * ones each IDLECHECK ms. Printing on STDOUT ends with the last connection
+ * of all workers.
+ * @param fd Timer descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void expireConns(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    int64_t now = ev_now();
+    
+    if (now >= idle_check) {
+        closeIdle(now);
+        idle_check = now + IDLECHECK * 1000;
+    }
+    while (wait_first != NULL && wait_first->expires <= now) {
+        TConn *conn = wait_first;
+        wait_first = conn->next_wait;
+        removeConn(&conns, conn);
+        if (__atomic_sub_fetch(&active, 1, __ATOMIC_RELAXED) == 0 && out_dir == NULL) {
+            stopWorkers();
+        }
+    }
+    if (wait_first != NULL && wait_first->expires < idle_check) {
+        ev_timer_arm(wait_timer, wait_first->expires - now);
+    } else {
+        ev_timer_arm(wait_timer, idle_check - now);
+    }
+    if (wait_first == NULL) {
+        wait_last = NULL;
+    }
+}
+
+/**
+ * Marks connection which recieved data by current batch, they are printed
+ * after the batch.
+ * @param conn Connection.
+ */
+void markDirty(TConn *conn) {
+    if (!(conn->flags & CONN_DIRTY)) {
+        conn->flags |= CONN_DIRTY;
+        conn->next_dirty = dirty_list;
+        dirty_list = conn;
+    }
+}
+
+/**
+ * Prints data of connections recieved by current batch, FIN is answered
+ * and connection closed whether are all data before FIN printed.
+ */
+void flushConns() {
+    while (dirty_list != NULL) {
+        TConn *conn = dirty_list;
+        dirty_list = conn->next_dirty;
+        conn->flags &= ~CONN_DIRTY;
+        flushConn(conn);
+        if ((conn->flags & CONN_FIN) && firstBlank(&conn->buff) == conn->fin_seq) {
+            sendFinAck(conn);
+            closeConn(conn);
+        }
+    }
+}
+
+/**
+ * Buffering packet to connection buffer, compressed data are buffered decompressed.
+ * @param conn Connection.
+ * @param packet Decoded packet to store into buffer. 
+ * @return Returns 1 whether are data buffered else returns 0 - out of buffer range or malformed.
+ */
+int buffData(TConn *conn, RDTPacket *packet) {
+    unsigned int seq = packet->seq;
+    char *data = packet->data;
+    int len = packet->len;
+    
+    if (isBuffered(&conn->buff, seq)) { // Data already buffered - just duplicity
+        return 1;
+    }
+    if (packet->flags & LZ) {
+        if (!(conn->features & FEAT_LZ) ||
+            (len = lz_decompress(packet->data, packet->len, LZ_BUFFER, conn->buff.slot_size)) < 0) {
+            return 0;
+        }
+        data = LZ_BUFFER;
+    }
+    
+    // Store copy of data to buffer
+    if (toBuffer(&conn->buff, seq, data, len) == NULL) {
+        // Buffer can be full of waiting data, print them and try it again
+        flushConn(conn);
+        if (toBuffer(&conn->buff, seq, data, len) == NULL) {
+            return 0;
+        }
+    }
+    if (conn->fec.block_size) {   // New data are added into parity of their block as they came
+        fecAdd(&conn->fec, seq, packet->data, packet->len, packet->flags & LZ);
+    }
+    return 1;
+}
+
+/**
+ * Acknowledges recieved packet. ACK is sent at once on gap, duplicity or
+ * after ack_every packets, otherwise it is delayed for at most ack_delay ms.
+ * @param conn Connection.
+ * @param seq Sequence number of recieved packet.
+ * @param expected First unbuffered sequence before the packet was buffered.
+ */
+void ackPacket(TConn *conn, unsigned int seq, unsigned int expected) {
+    unsigned int blank = firstBlank(&conn->buff);
+    
+    conn->ack_pending++;
+    if ((seq != expected)           // Out of order or duplicity - gap is reported at once
+        || (blank != seq + 1)       // Gap has been filled
+        || (conn->ack_pending >= conn->ack_every)
+        || (ack_delay == 0)) {
+        sendACK(conn, blank);
+    } else if (!(conn->flags & CONN_ACK)) {  // First delayed packet - wait for ACK timer
+        if (ack_list == NULL) {
+            ev_timer_arm(ack_timer, ack_delay * 1000);
+        }
+        conn->flags |= CONN_ACK;
+        conn->next_ack = ack_list;
+        ack_list = conn;
+    }
+}
+
+/**
+ * Rebuilds lost packet of block by parity without retransmission, rebuilt
+ * packet is buffered and acknowledged as whether was recieved.
+ * @param conn Connection.
+ * @param seq Sequence number of any packet of block.
+ */
+void repairData(TConn *conn, unsigned int seq) {
+    RDTPacket packet;
+    
+    if (conn->fec.block_size && fecRepair(&conn->fec, &conn->buff, seq, &packet)) {
+        unsigned int expected = firstBlank(&conn->buff);
+        if (buffData(conn, &packet)) {
+            markDirty(conn);
+            ackPacket(conn, packet.seq, expected);
+        }
+    }
+}
+
+/**
+ * Timer handler - sends delayed ACKs of all waiting connections.
+ * @param fd Timer descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void delayedACK(int fd, unsigned int events, void *data) {
+    (void)fd; (void)events; (void)data;
+    while (ack_list != NULL) {
+        TConn *conn = ack_list;
+        ack_list = conn->next_ack;
+        conn->flags &= ~CONN_ACK;
+        if (conn->ack_pending) {   // ACK could be already sent
+            sendACK(conn, firstBlank(&conn->buff));
+        }
+    }
+    flushStatus();
+}
+
+/**
+ * Processes recieved packet - finds its connection, buffers data and acknowledges them.
+ * @param recv_packet Recieved packet. 
+ * @param n Length of recieved packet. 
+ * @param addr Source address of packet. 
+ * @param port Source port of packet. 
+ */
+void processPacket(char *recv_packet, int n, in_addr_t addr, in_port_t port) {
+    RDTPacket view;   /**< decoded header of recieved packet */
+    RDTParams params; /**< parameters of SYN */
+    TConn *conn;      /**< connection of packet */
+
+    // Check whether has at least header and checksum passes
+	if (parsePacket(recv_packet, n, &view)) {
+        conn = findConn(&conns, view.conn);
+        if (conn != NULL && (conn->flags & CONN_WAIT) && (view.flags & SYN)) {
+            sendReject(&view, RST, addr, port);   // ID of closed connection - client picks another one
+            return;
+        }
+        if (conn != NULL && (conn->flags & CONN_IDLE)) {  // Data were dropped - transfer cannot end by FIN
+            sendReject(&view, SYN | NACK, addr, port);
+            return;
+        }
+        if (conn != NULL && (conn->flags & CONN_WAIT)) {  // Closed connection - answer to FIN was lost
+            conn->addr = addr;
+            conn->port = port;
+            sendFinAck(conn);
+            return;
+        }
+        if (conn != NULL) {
+            touchConn(conn, batch_now);
+        }
+        if (view.flags & FIN) {  // End of transfer - answered whether all data are printed
+            if (conn != NULL) {
+                conn->addr = addr;
+                conn->port = port;
+                conn->flags |= CONN_FIN;
+                conn->fin_seq = view.seq;
+                markDirty(conn);
+            }
+            return;
+        }
+        if (view.flags & SYN) {  // Connection setup, repeated SYN is answered again
+            if (conn == NULL) {
+                if (!parseSyn(&view, &params)) return;
+                if (out_dir == NULL && __atomic_exchange_n(&stdout_taken, 1, __ATOMIC_RELAXED)) {
+                    sendReject(&view, RST | FIN, addr, port);   // STDOUT prints only one transfer
+                    return;
+                }
+                conn = openConn(view.conn, &params);
+            } else if (conn->addr != addr || conn->port != port) {
+                sendReject(&view, RST, addr, port);   // ID is used by another client - client picks another one
+                return;
+            }
+            conn->addr = addr;
+            conn->port = port;
+            conn->sum_flag = view.flags & CRC;
+            sendSynAck(conn);
+            return;
+        }
+        if (conn == NULL) {  // Data without SYN - SYN was reordered or lost, client repeats data after answer
+            sendReject(&view, SYN | NACK, addr, port);
+            return;
+        }
+        conn->addr = addr;   // Answering where packet came from
+        conn->port = port;
+        conn->sum_flag = view.flags & CRC;   // Answering by the same checksum
+        if (view.flags & FEC) {  // Parity of block - it is not acknowledged
+            if (conn->fec.block_size && fecParity(&conn->fec, &view)) {
+                repairData(conn, view.seq);
+            }
+            return;
         }
         
-        getData(packet, data);
-        data[dataLen(packet)] = '\0';
-        
-        // Store to buffer
-        if (data != NULL) {
-            toBuffer(&output_buff, seq, data);
+        // Buffering and sending ACK, data out of buffer are not acknowledged
+        unsigned int expected = firstBlank(&conn->buff);
+        if (!(conn->features & FEAT_SR) && view.seq != expected) {
+            // Go-Back-N - only the next packet is accepted, the rest is repeated by client
+            sendACK(conn, expected);
+        } else if (buffData(conn, &view)) {
+            markDirty(conn);
+            ackPacket(conn, view.seq, expected);
+            repairData(conn, view.seq);
         }
-    }  
+    } else if (n >= DATA_OFFSET && (conn = findConn(&conns, connId(recv_packet))) != NULL &&
+               !(conn->flags & CONN_WAIT)) {
+        // Bad packet of known connection - send NACK of first unfinished
+        sendNACK(conn, firstBlank(&conn->buff));
+    }
+}
+
+/**
+ * Socket handler - reads all waiting packets by batches, then prints
+ * in-order data and sends ACKs at once.
+ * @param fd Socket descriptor. 
+ * @param events Occured events. 
+ * @param data Unused. 
+ */
+void recvPackets(int fd, unsigned int events, void *data) {
+    (void)events; (void)data;
+	udt_datagram dgrams[UDT_BATCH];   /**< recieved datagrams */
+	int n;
+	
+	batch_now = ev_now();
+	do {
+        for (int i = 0; i < UDT_BATCH; i++) {
+            dgrams[i].buff = &recv_packets[i * RCV_PACKETSIZE];
+            dgrams[i].nbytes = RCV_PACKETSIZE;
+        }
+        n = udt_recv_batch(fd, dgrams, UDT_BATCH);
+        for (int i = 0; i < n; i++) {
+            // Datagram can contain more packets coalesced by receive offload
+            char *packet = dgrams[i].buff;
+            int left = dgrams[i].nbytes, len;
+            uint16_t wire_len;
+            while (left > 0) {
+                len = left;
+                if (left >= DATA_OFFSET) {   // Header can be unaligned yet - length is copied
+                    memcpy(&wire_len, &packet[LEN_OFFSET], sizeof(wire_len));
+                    if (DATA_OFFSET + ntohs(wire_len) <= left) {
+                        len = DATA_OFFSET + ntohs(wire_len);
+                    }
+                }
+                if ((uintptr_t)packet % PACKET_ALIGN) {   // Segment length is not multiple of alignment
+                    memcpy(ALIGN_BUFFER, packet, len);
+                    processPacket(ALIGN_BUFFER, len, dgrams[i].addr, dgrams[i].port);
+                } else {
+                    processPacket(packet, len, dgrams[i].addr, dgrams[i].port);
+                }
+                packet += len;
+                left -= len;
+            }
+        }
+	} while (n == UDT_BATCH);   // Socket could be not drained
+	
+	flushConns();
+	flushStatus();
 }
 
 /**
@@ -175,73 +781,164 @@ void buffData(char *packet) {
  * @param argv Array with run params.
  * @return Return 0 on success or 1 on fail.    
  */
-// int readParams(int argc, char **argv) {
-// 	char ch;
-// 	while ((ch = getopt(argc,argv,"s:d:")) != -1) {
-// 		switch(ch) {
-// 		case 's':  // Source port
-// 			src_port = atol(optarg);
-// 			break;
-// 		case 'd':  // Destination port
-// 			dest_port = atol(optarg);
-// 			break;
-// 		case '?':  // Unknown flag, print error
-// 			fprintf(stderr, "%s", MSGS[MSG_USAGE]);;
-//         }
-// 	}
-
-// 	// Missing params or bad params.
-// 	if (src_port == 0 || dest_port == 0) {
-// 		printError(E_BADPARAMS);
-// 	}
+int readParams(int argc, char **argv) {
+	int ch;
+	while ((ch = getopt(argc,argv,"s:d:b:p:a:t:go:n:c")) != -1) {
+		switch(ch) {
+		case 's':  // Source port
+			src_port = atol(optarg);
+			break;
+		case 'd':  // Destination port - ACKs go to source of packets, kept for compatibility
+			break;
+		case 'b':  // Buffer size
+			buffer_size = atol(optarg);
+			if (buffer_size == 0 || buffer_size > BUFFERMAX) {
+				printError(E_BUFFERSIZE);
+			}
+			break;
+		case 'p':  // Data size
+			data_size = atol(optarg);
+			if (data_size == 0 || data_size > MAX_DATASIZE) {
+				printError(E_DATASIZE);
+			}
+			break;
+		case 'a':  // Number of packets acknowledged at once
+			ack_every = atol(optarg);
+			if (ack_every == 0) ack_every = 1;
+			break;
+		case 't':  // Delay of ACK
+			ack_delay = atol(optarg);
+			break;
+		case 'g':  // Receive offload
+			gro = 1;
+			break;
+		case 'o':  // Output directory, each connection has own file
+			out_dir = optarg;
+			break;
+		case 'n':  // Number of workers
+			worker_count = atol(optarg);
+			if (worker_count == 0 || worker_count > WORKERMAX) {
+				printError(E_WORKERS);
+			}
+			break;
+		case 'c':  // Pinning of workers
+			pin_cpu = 1;
+			break;
+		case '?':  // Unknown flag, print error
+			fprintf(stderr, "%s", MSGS[MSG_USAGE]);;
+        }
+	}
+
+	// Missing params or bad params.
+	if (src_port == 0) {
+		printError(E_BADPARAMS);
+	}
 	
-// 	// Many params
-//     if (argc > 5) {
-// 		fprintf(stderr, "%s", MSGS[MSG_MANYPARAMS]);
-// 	}
-// 	return 1;
-// }
+	// Many params
+    if (optind < argc) {
+		fprintf(stderr, "%s", MSGS[MSG_MANYPARAMS]);
+	}
+	return 1;
+}
 
-int main(int argc, char **argv ) {
-    printf(" Listening to PORT \n");
-	char recv_packet[RCV_PACKETSIZE];
-    printf(" Reading Packet \n");
-
-    initBuffer(&output_buff);     // Initialize STDOUT buffer.
-    // readParams(argc, argv);       // Reads params.
-	udt = udt_init(src_port);     // Returns socket descriptor.
-
-	fd_set readfds;
-	FD_ZERO(&readfds);
-	FD_SET(udt, &readfds);
-	while (select(udt+1, &readfds, NULL, NULL, NULL)) {
-		if (FD_ISSET(udt, &readfds)) {	
-			int n = udt_recv(udt, recv_packet, RCV_PACKETSIZE, NULL, NULL);
-            printf(" Packet Recieved \n");
-			
-            // Check whether has at least header and checksum passes
-            printf(" Checking Packet Header and Checksum\n");
-   			if (n >= DATA_OFFSET && testCheckSum(recv_packet, n)) {
-                if (!hasFlags(recv_packet, END)) {
-                    // Buffering and sending ACK
-                    buffData(recv_packet);
-                    printf(" \n Sending Acknowledgment\n");
-                    sendACK(seqNumber(recv_packet));
-                } else { // END flags specified - exiting
-                    break;
-                }
-            } else { // Bad packet - send NACK of first unfinished
-                printf(" Bad Packet recieved sending NACK");
-                sendNACK(firstBlank(&output_buff));
-            } 
-		}
-		// waiting for new packets
-		FD_ZERO(&readfds);
-		FD_SET(udt, &readfds);
+/**
+ * Returns CPU of worker - workers are spread over CPUs allowed for process.
+ * @param index Index of worker.
+ * @return Returns CPU number or -1 whether cannot be found.
+ */
+int workerCpu(unsigned int index) {
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0 || CPU_COUNT(&set) == 0) {
+        return -1;
+    }
+    index %= CPU_COUNT(&set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set) && index-- == 0) {
+            return cpu;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Runs worker - serves connections of its socket until workers are stopped.
+ * @param arg Pointer to worker.
+ * @return Returns NULL.
+ */
+void *runWorker(void *arg) {
+    TWorker *worker = arg;
+    
+    if (worker->cpu != -1) {   // Worker stays unpinned on fail
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(worker->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+    
+    // Initialize connection table.
+    udt = worker->udt;
+    if (!initTable(&conns) ||
+        (recv_packets = malloc(UDT_BATCH * RCV_PACKETSIZE)) == NULL) {
+        printError(E_MALLOC);
+    }
+
+    // Watching udt, stop event, delayed ACK and closing timers by event loop
+    if (!ev_init(&loop) ||
+        !ev_add(&loop, udt, EV_READ, recvPackets, NULL) ||
+        !ev_add(&loop, stop_fd, EV_READ, stopWorker, NULL) ||
+        (ack_timer = ev_timer(&loop, delayedACK, NULL)) == -1 ||
+        (wait_timer = ev_timer(&loop, expireConns, NULL)) == -1) {
+        printError(E_EVLOOP);
+    }
+    idle_check = ev_now() + IDLECHECK * 1000;
+    ev_timer_arm(wait_timer, IDLECHECK * 1000);
+    
+	// Wait for new packets until the last connection is closed
+	if (!ev_run(&loop)) {
+        printError(E_EVLOOP);
 	}
 	
-	destroyBuffer(&output_buff);
+	ev_destroy(&loop);
+	destroyTable(&conns);
+	free(recv_packets);
+	return NULL;
+}
 
+int main(int argc, char **argv ) {
+    readParams(argc, argv);       // Reads params.
+    checksumInit();               // Workers share selected implementation
+    if ((workers = calloc(worker_count, sizeof(TWorker))) == NULL) {
+        printError(E_MALLOC);
+    }
+    if ((stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1) {
+        printError(E_EVLOOP);
+    }
+    
+    // Sockets share port, they are bound in order of workers - steering indexes them so
+    for (unsigned int i = 0; i < worker_count; i++) {
+        workers[i].udt = worker_count > 1 ? udt_init_reuseport(src_port) : udt_init(src_port);
+        workers[i].cpu = pin_cpu ? workerCpu(i) : -1;
+        if (gro && !udt_enable_gro(workers[i].udt) && i == 0) {
+            fprintf(stderr, "%s", MSGS[MSG_NOGRO]);      // Packets come one by one
+        }
+    }
+    if (worker_count > 1 && !udt_steer_reuseport(workers[0].udt, worker_count, CONN_OFFSET)) {
+        fprintf(stderr, "%s", MSGS[MSG_NOSTEER]);        // Flows stay on worker by address
+    }
+    
+    // The first worker runs in main thread
+    for (unsigned int i = 1; i < worker_count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, runWorker, &workers[i]) != 0) {
+            printError(E_THREAD);
+        }
+    }
+    runWorker(&workers[0]);
+    for (unsigned int i = 1; i < worker_count; i++) {
+        pthread_join(workers[i].thread, NULL);
+    }
+    
+    close(stop_fd);
+    free(workers);
 	return EXIT_SUCCESS;
 }
 